@@ -13,6 +13,9 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/swap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -118,6 +121,9 @@ static void print_stats(void) {
   thread_print_stats();
 #ifdef FILESYS
   block_print_stats();
+#endif
+#ifdef VM
+  swap_print_stats();
 #endif
   console_print_stats();
   kbd_print_stats();
@@ -20,34 +20,42 @@ static bool list_dir(const char* dir, bool verbose) {
   }
 
   if (isdir(dir_fd)) {
-    char name[READDIR_MAX_LEN];
+    char buf[512];
+    int size;
 
     printf("%s", dir);
     if (verbose)
       printf(" (inumber %d)", inumber(dir_fd));
     printf(":\n");
 
-    while (readdir(dir_fd, name)) {
-      printf("%s", name);
-      if (verbose) {
-        char full_name[128];
-        int entry_fd;
+    /* Each getdents() returns as many entries as fit in BUF. */
+    while ((size = getdents(dir_fd, buf, sizeof buf)) > 0) {
+      int ofs;
 
-        snprintf(full_name, sizeof full_name, "%s/%s", dir, name);
-        entry_fd = open(full_name);
+      for (ofs = 0; ofs < size; ofs += ((struct dirent*)(buf + ofs))->d_reclen) {
+        struct dirent* d = (struct dirent*)(buf + ofs);
 
-        printf(": ");
-        if (entry_fd != -1) {
-          if (isdir(entry_fd))
+        printf("%s", d->d_name);
+        if (verbose) {
+          printf(": ");
+          if (d->d_type == DT_DIR)
             printf("directory");
-          else
-            printf("%d-byte file", filesize(entry_fd));
-          printf(", inumber %d", inumber(entry_fd));
-        } else
-          printf("open failed");
-        close(entry_fd);
+          else {
+            char full_name[128];
+            int entry_fd;
+
+            snprintf(full_name, sizeof full_name, "%s/%s", dir, d->d_name);
+            entry_fd = open(full_name);
+            if (entry_fd != -1)
+              printf("%d-byte file", filesize(entry_fd));
+            else
+              printf("open failed");
+            close(entry_fd);
+          }
+          printf(", inumber %d", (int)d->d_ino);
+        }
+        printf("\n");
       }
-      printf("\n");
     }
   } else
     printf("%s: not a directory\n", dir);
@@ -0,0 +1,270 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache of file system sectors.
+
+   Every sector the file system reads or writes goes through a
+   fixed set of CACHE_SIZE buffers, replaced by the clock
+   algorithm.  Writes only dirty a buffer: dirty buffers reach
+   the disk when they are evicted, when the flusher thread calls
+   filesys_sync() every FLUSH_INTERVAL ticks, and from
+   filesys_done().  A read-ahead thread fetches sectors that
+   cache_read_ahead() says will soon be wanted, so that
+   sequential readers find them already cached.
+
+   A buffer written with cache_write_logged() belongs to the
+   journal's running transaction.  It is neither evicted nor
+   flushed until the transaction commits and cache_install()
+   writes it to its home sector, so that the disk never sees
+   part of a transaction outside the log.
+
+   cache_lock protects all of the cache.  Disk I/O is done
+   without it, with the buffer marked busy so that nobody else
+   uses or evicts it until the I/O completes. */
+
+#define CACHE_SIZE 64                  /* Number of buffers. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ) /* Ticks between flushes. */
+#define READ_AHEAD_MAX 16              /* Most queued read-aheads. */
+
+/* A cached sector. */
+struct cache_entry {
+  block_sector_t sector; /* Sector held, if valid. */
+  bool valid;            /* Holds a sector? */
+  bool dirty;            /* Modified since read or written? */
+  bool accessed;         /* Used since the clock hand passed? */
+  bool busy;             /* I/O in progress? */
+  bool logged;           /* Held back for the journal? */
+  uint8_t data[BLOCK_SECTOR_SIZE];
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_idle; /* Signaled when I/O completes. */
+static size_t clock_hand;
+
+/* Sectors queued for read-ahead, a ring buffer. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct condition read_ahead_ready;
+
+static thread_func flusher;
+static thread_func read_ahead_daemon;
+
+/* Initializes the buffer cache and starts its threads. */
+void cache_init(void) {
+  lock_init(&cache_lock);
+  cond_init(&cache_idle);
+  cond_init(&read_ahead_ready);
+  thread_create("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Returns the buffer holding SECTOR, or a null pointer if none
+   does.  cache_lock must be held. */
+static struct cache_entry* lookup(block_sector_t sector) {
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Writes dirty buffer E to disk.  cache_lock must be held; it is
+   released during the write. */
+static void write_back(struct cache_entry* e) {
+  ASSERT(e->dirty && !e->busy);
+
+  e->busy = true;
+  lock_release(&cache_lock);
+  block_write(fs_device, e->sector, e->data);
+  lock_acquire(&cache_lock);
+  e->busy = false;
+  e->dirty = false;
+  cond_broadcast(&cache_idle, &cache_lock);
+}
+
+/* Returns a buffer holding SECTOR, reading it from disk if it is
+   not cached, unless FILL is false because the caller will
+   overwrite all of it.  cache_lock must be held; it may be
+   released and reacquired while waiting for I/O. */
+static struct cache_entry* get_entry(block_sector_t sector, bool fill) {
+  for (;;) {
+    struct cache_entry* e = lookup(sector);
+    size_t i;
+
+    if (e != NULL) {
+      if (!e->busy) {
+        e->accessed = true;
+        return e;
+      }
+      cond_wait(&cache_idle, &cache_lock);
+      continue;
+    }
+
+    /* Choose a victim: two sweeps of the clock clear every
+       accessed bit. */
+    for (i = 0; i < 2 * CACHE_SIZE; i++) {
+      e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (e->busy || e->logged)
+        continue;
+      if (!e->valid)
+        break;
+      if (!e->accessed)
+        break;
+      e->accessed = false;
+    }
+    if (e->busy || e->logged || (e->valid && e->accessed)) {
+      cond_wait(&cache_idle, &cache_lock);
+      continue;
+    }
+    if (e->valid && e->dirty) {
+      /* Someone may cache SECTOR while we write, so start over
+         afterward. */
+      write_back(e);
+      continue;
+    }
+
+    e->sector = sector;
+    e->valid = true;
+    e->dirty = false;
+    e->accessed = true;
+    if (fill) {
+      e->busy = true;
+      lock_release(&cache_lock);
+      block_read(fs_device, sector, e->data);
+      lock_acquire(&cache_lock);
+      e->busy = false;
+      cond_broadcast(&cache_idle, &cache_lock);
+    }
+    return e;
+  }
+}
+
+/* Reads SIZE bytes at offset OFS within SECTOR into BUFFER. */
+void cache_read(block_sector_t sector, void* buffer, size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire(&cache_lock);
+  e = get_entry(sector, true);
+  memcpy(buffer, e->data + ofs, size);
+  lock_release(&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR,
+   holding the buffer back for the journal if LOGGED is true. */
+static void write_entry(block_sector_t sector, const void* buffer, size_t ofs, size_t size,
+                        bool logged) {
+  struct cache_entry* e;
+
+  ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire(&cache_lock);
+  e = get_entry(sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy(e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (logged)
+    e->logged = true;
+  lock_release(&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR. */
+void cache_write(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  write_entry(sector, buffer, ofs, size, false);
+}
+
+/* Writes like cache_write(), but for a sector in the journal's
+   running transaction: the buffer stays in the cache, unwritten,
+   until cache_install() is called for it. */
+void cache_write_logged(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  write_entry(sector, buffer, ofs, size, true);
+}
+
+/* Writes like cache_write(), then writes SECTOR to disk before
+   returning, so that journaled metadata that will point to it
+   cannot reach the disk first. */
+void cache_write_through(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  struct cache_entry* e;
+
+  ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+  lock_acquire(&cache_lock);
+  e = get_entry(sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  ASSERT(!e->logged);
+  memcpy(e->data + ofs, buffer, size);
+  e->dirty = true;
+  write_back(e);
+  lock_release(&cache_lock);
+}
+
+/* Writes SECTOR, whose transaction has committed, to its home
+   location and lets it be evicted again. */
+void cache_install(block_sector_t sector) {
+  struct cache_entry* e;
+
+  lock_acquire(&cache_lock);
+  e = lookup(sector);
+  ASSERT(e != NULL && e->logged);
+  while (e->busy)
+    cond_wait(&cache_idle, &cache_lock);
+  e->logged = false;
+  if (e->dirty)
+    write_back(e);
+  lock_release(&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+   The request is dropped if too many are already pending. */
+void cache_read_ahead(block_sector_t sector) {
+  lock_acquire(&cache_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX && lookup(sector) == NULL) {
+    read_ahead_queue[(read_ahead_head + read_ahead_cnt++) % READ_AHEAD_MAX] = sector;
+    cond_signal(&read_ahead_ready, &cache_lock);
+  }
+  lock_release(&cache_lock);
+}
+
+/* Writes every dirty buffer to disk, except for those held back
+   for the journal. */
+void cache_flush(void) {
+  size_t i;
+
+  lock_acquire(&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++) {
+    struct cache_entry* e = &cache[i];
+    while (e->busy)
+      cond_wait(&cache_idle, &cache_lock);
+    if (e->valid && e->dirty && !e->logged)
+      write_back(e);
+  }
+  lock_release(&cache_lock);
+}
+
+/* Periodically writes deferred metadata and dirty buffers to
+   disk, bounding how much is lost in a crash. */
+static void flusher(void* aux UNUSED) {
+  for (;;) {
+    timer_sleep(FLUSH_INTERVAL);
+    filesys_sync();
+  }
+}
+
+/* Reads in sectors queued by cache_read_ahead(). */
+static void read_ahead_daemon(void* aux UNUSED) {
+  lock_acquire(&cache_lock);
+  for (;;) {
+    block_sector_t sector;
+
+    while (read_ahead_cnt == 0)
+      cond_wait(&read_ahead_ready, &cache_lock);
+    sector = read_ahead_queue[read_ahead_head];
+    read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+    read_ahead_cnt--;
+    get_entry(sector, true);
+  }
+}
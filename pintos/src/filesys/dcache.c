@@ -0,0 +1,152 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the results of recent directory lookups, keyed by
+   the directory's inode sector and the name looked up, so that
+   resolving the same names again needs no directory I/O.  A
+   negative entry, with sector 0, records that the name does not
+   exist; sector 0 holds the free map's inode, which is never
+   named in a directory.
+
+   dir_add() and dir_remove() invalidate the entry for the name
+   they change and then record the new result, and dir_create()
+   purges every entry for a directory whose sector is being
+   reused.  At most DCACHE_SIZE entries are kept; the least
+   recently used one is dropped to make room. */
+
+#define DCACHE_SIZE 256
+
+/* A cached lookup result. */
+struct dcache_entry {
+  struct hash_elem hash_elem; /* Element in dcache. */
+  struct list_elem lru_elem;  /* Element in lru_list. */
+  block_sector_t dir;         /* Directory's inode sector. */
+  char name[NAME_MAX + 1];    /* Name looked up. */
+  block_sector_t sector;      /* Inode sector of NAME, or 0. */
+};
+
+static struct hash dcache;
+static struct list lru_list; /* Most recently used first. */
+static struct lock dcache_lock;
+
+static unsigned dcache_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct dcache_entry* d = hash_entry(e, struct dcache_entry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->dir);
+}
+
+static bool dcache_less(const struct hash_elem* a_, const struct hash_elem* b_,
+                        void* aux UNUSED) {
+  const struct dcache_entry* a = hash_entry(a_, struct dcache_entry, hash_elem);
+  const struct dcache_entry* b = hash_entry(b_, struct dcache_entry, hash_elem);
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp(a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void dcache_init(void) {
+  hash_init(&dcache, dcache_hash, dcache_less, NULL);
+  list_init(&lru_list);
+  lock_init(&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  dcache_lock must be held. */
+static struct dcache_entry* find(block_sector_t dir, const char* name) {
+  struct dcache_entry key;
+  struct hash_elem* e;
+
+  if (strlen(name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy(key.name, name, sizeof key.name);
+  e = hash_find(&dcache, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Removes entry D and frees it.  dcache_lock must be held. */
+static void drop(struct dcache_entry* d) {
+  hash_delete(&dcache, &d->hash_elem);
+  list_remove(&d->lru_elem);
+  free(d);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the result is cached, returns true and stores the sector
+   of NAME's inode in *SECTORP, or 0 if NAME is known not to
+   exist.  Returns false if nothing is cached for NAME. */
+bool dcache_lookup(block_sector_t dir, const char* name, block_sector_t* sectorp) {
+  struct dcache_entry* d;
+
+  lock_acquire(&dcache_lock);
+  d = find(dir, name);
+  if (d != NULL) {
+    list_remove(&d->lru_elem);
+    list_push_front(&lru_list, &d->lru_elem);
+    *sectorp = d->sector;
+  }
+  lock_release(&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR names the inode in SECTOR, or does not exist if SECTOR is
+   0. */
+void dcache_insert(block_sector_t dir, const char* name, block_sector_t sector) {
+  struct dcache_entry* d;
+
+  if (strlen(name) > NAME_MAX)
+    return;
+
+  lock_acquire(&dcache_lock);
+  d = find(dir, name);
+  if (d == NULL) {
+    if (hash_size(&dcache) >= DCACHE_SIZE)
+      drop(list_entry(list_back(&lru_list), struct dcache_entry, lru_elem));
+    d = malloc(sizeof *d);
+    if (d != NULL) {
+      d->dir = dir;
+      strlcpy(d->name, name, sizeof d->name);
+      hash_insert(&dcache, &d->hash_elem);
+      list_push_front(&lru_list, &d->lru_elem);
+    }
+  }
+  if (d != NULL)
+    d->sector = sector;
+  lock_release(&dcache_lock);
+}
+
+/* Forgets any cached result for NAME in the directory whose
+   inode is in sector DIR. */
+void dcache_invalidate(block_sector_t dir, const char* name) {
+  struct dcache_entry* d;
+
+  lock_acquire(&dcache_lock);
+  d = find(dir, name);
+  if (d != NULL)
+    drop(d);
+  lock_release(&dcache_lock);
+}
+
+/* Forgets every cached result for the directory whose inode is
+   in sector DIR. */
+void dcache_purge(block_sector_t dir) {
+  struct list_elem *e, *next;
+
+  lock_acquire(&dcache_lock);
+  for (e = list_begin(&lru_list); e != list_end(&lru_list); e = next) {
+    struct dcache_entry* d = list_entry(e, struct dcache_entry, lru_elem);
+    next = list_next(e);
+    if (d->dir == dir)
+      drop(d);
+  }
+  lock_release(&dcache_lock);
+}
@@ -0,0 +1,13 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t dir, const char* name, block_sector_t* sectorp);
+void dcache_insert(block_sector_t dir, const char* name, block_sector_t sector);
+void dcache_invalidate(block_sector_t dir, const char* name);
+void dcache_purge(block_sector_t dir);
+
+#endif /* filesys/dcache.h */
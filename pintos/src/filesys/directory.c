@@ -1,15 +1,21 @@
 #include "filesys/directory.h"
+#include <dirent.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/vfs.h"
 #include "threads/malloc.h"
 
 /* A directory. */
 struct dir {
   struct inode* inode; /* Backing store. */
-  off_t pos;           /* Current position. */
+  off_t pos;           /* Current position, as an entry index. */
 };
 
 /* A single directory entry. */
@@ -17,14 +23,135 @@ struct dir_entry {
   block_sector_t inode_sector; /* Sector number of header. */
   char name[NAME_MAX + 1];     /* Null terminated file name. */
   bool in_use;                 /* In use or free? */
+  bool is_dir;                 /* Names a directory? */
 };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
-bool dir_create(block_sector_t sector, size_t entry_cnt) {
-  return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
+/* A directory is an extendible hash table of names.
+
+   Sector 0 of the directory file holds a dir_header, whose table
+   maps the low DEPTH bits of a name's hash to a bucket.  Each
+   following sector holds one bucket of BUCKET_ENTRIES entries.
+   A bucket with local depth D holds exactly the names whose hash
+   has the low D bits it is indexed by, so 2**(DEPTH - D) table
+   slots point to it.
+
+   Looking a name up reads the table slot and then one bucket.
+   Adding a name to a full bucket splits it in two on the next
+   hash bit, doubling the table first if the bucket's depth is
+   already DEPTH.  At most MAX_SPLITS buckets are split per name
+   added, so that adding fits in one journal operation; adding
+   fails if the name's bucket is still full after that, which
+   random hashes make vanishingly rare, or when MAX_DEPTH bits
+   of hash cannot separate the names in a bucket.  Each bucket keeps a
+   hint to its first free slot, so a full bucket is recognized
+   without scanning it.
+
+   Directories form a tree.  The header records the sector of the
+   directory's parent, the root being its own parent, so that
+   ".." is found without storing it as an entry; "." is not
+   stored either.  A directory may only be removed while it is
+   empty, and once removed nothing can be added to it.
+
+   Looking up, adding, and removing names hold the directory
+   inode's lock, so that operations on one directory are atomic
+   with respect to each other while different directories are
+   used in parallel. */
+
+/* Deepest table supported; the table must fit in a sector. */
+#define MAX_DEPTH 8
+#define MAX_BUCKETS (1 << MAX_DEPTH)
+
+/* Most buckets split by one dir_add().  Creating a directory
+   logs its inode, header, and bucket, and a split logs the
+   parent's inode, header, two buckets, and up to two index
+   blocks, just within MAX_OP_BLOCKS in filesys/log.c. */
+#define MAX_SPLITS 1
+
+/* Header of a directory, in its first sector. */
+struct dir_header {
+  uint32_t entry_cnt;            /* Number of entries in use. */
+  uint16_t bucket_cnt;           /* Number of buckets. */
+  uint8_t depth;                 /* Number of hash bits in use. */
+  uint8_t unused;                /* Not used. */
+  block_sector_t parent;         /* Inode sector of parent directory. */
+  uint8_t table[MAX_BUCKETS];    /* Bucket for each hash value. */
+};
+
+#define BUCKET_ENTRIES ((BLOCK_SECTOR_SIZE - 4) / sizeof(struct dir_entry))
+
+/* A bucket of directory entries, one sector long. */
+struct dir_bucket {
+  uint8_t depth;     /* Number of hash bits shared by entries. */
+  uint8_t free_hint; /* First free entry, or BUCKET_ENTRIES. */
+  uint16_t unused;   /* Not used. */
+  struct dir_entry entries[BUCKET_ENTRIES];
+  uint8_t pad[BLOCK_SECTOR_SIZE - 4 - BUCKET_ENTRIES * sizeof(struct dir_entry)];
+};
+
+/* Returns the byte offset of bucket IDX in a directory file. */
+static off_t bucket_ofs(size_t idx) { return (idx + 1) * BLOCK_SECTOR_SIZE; }
+
+/* Returns the byte offset of entry SLOT of bucket IDX. */
+static off_t entry_ofs(size_t idx, size_t slot) {
+  return bucket_ofs(idx) + offsetof(struct dir_bucket, entries) + slot * sizeof(struct dir_entry);
 }
 
+/* Returns the index of the first free entry in BUCKET at or after
+   SLOT, or BUCKET_ENTRIES if there is none. */
+static uint8_t next_free(const struct dir_bucket* bucket, size_t slot) {
+  while (slot < BUCKET_ENTRIES && bucket->entries[slot].in_use)
+    slot++;
+  return slot;
+}
+
+/* Returns true if NAME is "." or "..", which always exist and
+   are not stored as entries. */
+static bool is_dot(const char* name) { return !strcmp(name, ".") || !strcmp(name, ".."); }
+
+/* Creates a directory with space for ENTRY_CNT entries in the
+   given SECTOR, as a subdirectory of the directory whose inode is
+   in PARENT.  Returns true if successful, false on failure. */
+bool dir_create(block_sector_t sector, block_sector_t parent, size_t entry_cnt) {
+  struct dir_header* header;
+  struct dir_bucket* bucket;
+  struct inode* inode = NULL;
+  size_t depth, i;
+  bool success = false;
+
+  ASSERT(sizeof *header <= BLOCK_SECTOR_SIZE);
+  ASSERT(sizeof *bucket == BLOCK_SECTOR_SIZE);
+
+  for (depth = 0; depth < MAX_DEPTH && (BUCKET_ENTRIES << depth) < entry_cnt; depth++)
+    continue;
+
+  header = calloc(1, sizeof *header);
+  bucket = calloc(1, sizeof *bucket);
+  if (header == NULL || bucket == NULL ||
+      !inode_create(sector, bucket_ofs(1 << depth), INODE_DIRECTORY) ||
+      (inode = inode_open(sector)) == NULL)
+    goto done;
+  dcache_purge(sector);
+
+  header->bucket_cnt = 1 << depth;
+  header->depth = depth;
+  header->parent = parent;
+  for (i = 0; i < header->bucket_cnt; i++)
+    header->table[i] = i;
+  if (inode_write_at(inode, header, sizeof *header, 0) != sizeof *header)
+    goto done;
+
+  bucket->depth = depth;
+  for (i = 0; i < header->bucket_cnt; i++)
+    if (inode_write_at(inode, bucket, sizeof *bucket, bucket_ofs(i)) != sizeof *bucket)
+      goto done;
+  success = true;
+
+done:
+  inode_close(inode);
+  free(header);
+  free(bucket);
+  return success;
+}
 /* Opens and returns the directory for the given INODE, of which
    it takes ownership.  Returns a null pointer on failure. */
 struct dir* dir_open(struct inode* inode) {
@@ -65,133 +192,327 @@ struct inode* dir_get_inode(struct dir* dir) {
   return dir->inode;
 }
 
+/* Sets the position in DIR from which dir_readdir() reads next
+   to POS, a value previously returned by dir_tell(). */
+void dir_seek(struct dir* dir, off_t pos) {
+  ASSERT(pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position in DIR from which dir_readdir() reads
+   next. */
+off_t dir_tell(const struct dir* dir) {
+  return dir->pos;
+}
+
+/* Returns the bucket of DIR that holds names with hash HASH. */
+static size_t find_bucket(const struct dir* dir, unsigned hash) {
+  uint8_t depth, idx;
+
+  inode_read_at(dir->inode, &depth, 1, offsetof(struct dir_header, depth));
+  inode_read_at(dir->inode, &idx, 1,
+                offsetof(struct dir_header, table) + (hash & ((1u << depth) - 1)));
+  return idx;
+}
+
+/* Returns the slot of the entry for NAME in BUCKET, or
+   BUCKET_ENTRIES if there is none. */
+static size_t find_entry(const struct dir_bucket* bucket, const char* name) {
+  size_t slot;
+
+  for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+    if (bucket->entries[slot].in_use && !strcmp(name, bucket->entries[slot].name))
+      break;
+  return slot;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
-static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
-  struct dir_entry e;
-  size_t ofs;
+   if EP is non-null, and sets *IDXP and *SLOTP to its bucket and
+   slot if they are non-null.
+   otherwise, returns false and ignores EP, IDXP, and SLOTP.
+   Either way, the result is recorded in the dentry cache. */
+static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, size_t* idxp,
+                   size_t* slotp) {
+  struct dir_bucket* bucket;
+  size_t idx, slot;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (e.in_use && !strcmp(name, e.name)) {
-      if (ep != NULL)
-        *ep = e;
-      if (ofsp != NULL)
-        *ofsp = ofs;
-      return true;
+  bucket = malloc(sizeof *bucket);
+  if (bucket == NULL)
+    return false;
+
+  idx = find_bucket(dir, hash_string(name));
+  slot = BUCKET_ENTRIES;
+  if (inode_read_at(dir->inode, bucket, sizeof *bucket, bucket_ofs(idx)) == sizeof *bucket) {
+    slot = find_entry(bucket, name);
+    dcache_insert(inode_get_inumber(dir->inode), name,
+                  slot < BUCKET_ENTRIES ? bucket->entries[slot].inode_sector : 0);
+  }
+  if (slot < BUCKET_ENTRIES) {
+    if (ep != NULL)
+      *ep = bucket->entries[slot];
+    if (idxp != NULL)
+      *idxp = idx;
+    if (slotp != NULL)
+      *slotp = slot;
+  }
+  free(bucket);
+  return slot < BUCKET_ENTRIES;
+}
+
+/* Splits BUCKET, which is bucket IDX of DIR and is full, moving
+   the entries whose next hash bit is set into a new bucket.
+   HEADER is DIR's header; it is updated and written back.
+   Returns true if successful, false if the table cannot grow
+   further or a disk error occurs. */
+static bool split_bucket(struct dir* dir, struct dir_header* header, size_t idx,
+                         struct dir_bucket* bucket) {
+  struct dir_bucket* new;
+  size_t new_idx, slot, i;
+  unsigned bit;
+  bool success = false;
+
+  if (bucket->depth == header->depth) {
+    if (header->depth == MAX_DEPTH)
+      return false;
+    memcpy(header->table + (1 << header->depth), header->table, 1 << header->depth);
+    header->depth++;
+  }
+
+  new = calloc(1, sizeof *new);
+  if (new == NULL)
+    return false;
+
+  /* Move entries with the new bit set. */
+  bit = 1u << bucket->depth;
+  new_idx = header->bucket_cnt;
+  bucket->depth++;
+  new->depth = bucket->depth;
+  for (slot = 0; slot < BUCKET_ENTRIES; slot++) {
+    struct dir_entry* e = &bucket->entries[slot];
+    if (e->in_use && (hash_string(e->name) & bit)) {
+      new->entries[slot] = *e;
+      e->in_use = false;
     }
-  return false;
+  }
+  bucket->free_hint = next_free(bucket, 0);
+  new->free_hint = next_free(new, 0);
+
+  /* Point half of the slots for the old bucket at the new one. */
+  for (i = 0; i < (1u << header->depth); i++)
+    if (header->table[i] == idx && (i & bit))
+      header->table[i] = new_idx;
+  header->bucket_cnt++;
+
+  if (inode_write_at(dir->inode, new, sizeof *new, bucket_ofs(new_idx)) == sizeof *new &&
+      inode_write_at(dir->inode, bucket, sizeof *bucket, bucket_ofs(idx)) == sizeof *bucket &&
+      inode_write_at(dir->inode, header, sizeof *header, 0) == sizeof *header)
+    success = true;
+  free(new);
+  return success;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   "." names DIR itself and ".." its parent.  A removed directory
+   contains nothing, not even these.  A directory that another
+   file system is mounted on is replaced by the root of that file
+   system.
+   Names looked up recently are resolved from the dentry cache
+   without reading DIR. */
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
   struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  if (lookup(dir, name, &e, NULL))
-    *inode = inode_open(e.inode_sector);
-  else
+  if (inode_is_removed(dir->inode))
     *inode = NULL;
+  else if (!strcmp(name, "."))
+    *inode = inode_reopen(dir->inode);
+  else if (!strcmp(name, "..")) {
+    inode_read_at(dir->inode, &sector, sizeof sector, offsetof(struct dir_header, parent));
+    *inode = inode_open(sector);
+  } else {
+    /* DIR's lock keeps a cached entry current until the inode is
+       open: dir_remove() invalidates it under the same lock,
+       before the removed inode's sector can be freed and reused
+       for another file. */
+    inode_lock(dir->inode);
+    if (dcache_lookup(inode_get_inumber(dir->inode), name, &sector))
+      *inode = sector != 0 ? inode_open(vfs_cross(sector)) : NULL;
+    else
+      *inode = lookup(dir, name, &e, NULL, NULL) ? inode_open(vfs_cross(e.inode_sector)) : NULL;
+    inode_unlock(dir->inode);
+  }
 
   return *inode != NULL;
 }
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR, and IS_DIR tells whether it is a directory.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
-bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
-  struct dir_entry e;
-  off_t ofs;
+   Fails if NAME is invalid (i.e. too long, "." or "..") or DIR
+   has been removed, if NAME's bucket is full even after
+   splitting, or if a disk or memory error occurs. */
+bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, bool is_dir) {
+  struct dir_header* header = NULL;
+  struct dir_bucket* bucket = NULL;
+  struct dir_entry* e;
+  unsigned hash;
+  size_t idx, splits;
   bool success = false;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen(name) > NAME_MAX)
+  if (*name == '\0' || strlen(name) > NAME_MAX || is_dot(name))
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup(dir, name, NULL, NULL))
+  inode_lock(dir->inode);
+  header = malloc(sizeof *header);
+  bucket = malloc(sizeof *bucket);
+  if (header == NULL || bucket == NULL || inode_is_removed(dir->inode) ||
+      inode_read_at(dir->inode, header, sizeof *header, 0) != sizeof *header)
     goto done;
+  dcache_invalidate(inode_get_inumber(dir->inode), name);
+
+  /* Find NAME's bucket, splitting it until it has a free slot. */
+  hash = hash_string(name);
+  for (splits = 0;; splits++) {
+    idx = header->table[hash & ((1u << header->depth) - 1)];
+    if (inode_read_at(dir->inode, bucket, sizeof *bucket, bucket_ofs(idx)) != sizeof *bucket)
+      goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+    /* Check that NAME is not in use. */
+    if (find_entry(bucket, name) < BUCKET_ENTRIES)
+      goto done;
 
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (!e.in_use)
+    if (bucket->free_hint < BUCKET_ENTRIES)
       break;
+    if (splits == MAX_SPLITS || !split_bucket(dir, header, idx, bucket))
+      goto done;
+  }
 
   /* Write slot. */
-  e.in_use = true;
-  strlcpy(e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+  e = &bucket->entries[bucket->free_hint];
+  e->in_use = true;
+  strlcpy(e->name, name, sizeof e->name);
+  e->inode_sector = inode_sector;
+  e->is_dir = is_dir;
+  bucket->free_hint = next_free(bucket, bucket->free_hint + 1);
+  header->entry_cnt++;
+  success = inode_write_at(dir->inode, bucket, sizeof *bucket, bucket_ofs(idx)) == sizeof *bucket &&
+            inode_write_at(dir->inode, &header->entry_cnt, sizeof header->entry_cnt,
+                           offsetof(struct dir_header, entry_cnt)) == sizeof header->entry_cnt;
+  if (success)
+    dcache_insert(inode_get_inumber(dir->inode), name, inode_sector);
 
 done:
+  inode_unlock(dir->inode);
+  free(header);
+  free(bucket);
   return success;
 }
 
+/* Returns true if directory INODE has no entries.  INODE's lock
+   must be held. */
+static bool dir_is_empty(struct inode* inode) {
+  uint32_t entry_cnt;
+
+  return inode_read_at(inode, &entry_cnt, sizeof entry_cnt, offsetof(struct dir_header, entry_cnt)) ==
+             sizeof entry_cnt &&
+         entry_cnt == 0;
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, NAME is "." or "..", or
+   NAME is a directory that is not empty or is a mount point. */
 bool dir_remove(struct dir* dir, const char* name) {
   struct dir_entry e;
   struct inode* inode = NULL;
+  bool locked = false;
   bool success = false;
-  off_t ofs;
+  uint8_t free_hint;
+  uint32_t entry_cnt;
+  size_t idx, slot;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  /* Find directory entry. */
-  if (!lookup(dir, name, &e, &ofs))
+  if (is_dot(name))
+    return false;
+
+  /* Find directory entry.  A mount point cannot be removed. */
+  inode_lock(dir->inode);
+  if (!lookup(dir, name, &e, &idx, &slot) || vfs_is_covered(e.inode_sector))
     goto done;
 
-  /* Open inode. */
+  /* Open inode.  A directory stays locked until it is marked
+     removed, so that nothing is added to it meanwhile. */
   inode = inode_open(e.inode_sector);
   if (inode == NULL)
     goto done;
+  if (inode_is_dir(inode)) {
+    inode_lock(inode);
+    locked = true;
+    if (!dir_is_empty(inode))
+      goto done;
+  }
 
-  /* Erase directory entry. */
+  /* Erase directory entry, updating the free slot hint and the
+     entry count. */
+  dcache_invalidate(inode_get_inumber(dir->inode), name);
   e.in_use = false;
-  if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
+  if (inode_write_at(dir->inode, &e, sizeof e, entry_ofs(idx, slot)) != sizeof e)
     goto done;
+  inode_read_at(dir->inode, &free_hint, 1, bucket_ofs(idx) + offsetof(struct dir_bucket, free_hint));
+  if (slot < free_hint) {
+    free_hint = slot;
+    inode_write_at(dir->inode, &free_hint, 1, bucket_ofs(idx) + offsetof(struct dir_bucket, free_hint));
+  }
+  inode_read_at(dir->inode, &entry_cnt, sizeof entry_cnt, offsetof(struct dir_header, entry_cnt));
+  entry_cnt--;
+  inode_write_at(dir->inode, &entry_cnt, sizeof entry_cnt, offsetof(struct dir_header, entry_cnt));
+  dcache_insert(inode_get_inumber(dir->inode), name, 0);
 
   /* Remove inode. */
   inode_remove(inode);
   success = true;
 
 done:
+  if (locked)
+    inode_unlock(inode);
+  inode_unlock(dir->inode);
   inode_close(inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Each entry is read atomically, but
+   entries added or removed meanwhile may or may not be seen. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   struct dir_entry e;
+  uint16_t bucket_cnt;
 
-  while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-    dir->pos += sizeof e;
+  if (inode_read_at(dir->inode, &bucket_cnt, sizeof bucket_cnt,
+                    offsetof(struct dir_header, bucket_cnt)) != sizeof bucket_cnt)
+    return false;
+  while ((size_t)dir->pos < bucket_cnt * BUCKET_ENTRIES) {
+    size_t idx = dir->pos / BUCKET_ENTRIES, slot = dir->pos % BUCKET_ENTRIES;
+    if (inode_read_at(dir->inode, &e, sizeof e, entry_ofs(idx, slot)) != sizeof e)
+      return false;
+    dir->pos++;
     if (e.in_use) {
       strlcpy(name, e.name, NAME_MAX + 1);
       return true;
@@ -199,3 +520,53 @@ bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   }
   return false;
 }
+
+/* Stores as many of DIR's entries as fit in the SIZE bytes at
+   BUFFER, as struct dirent records, starting from DIR's position
+   and advancing it past the entries stored.  Unlike
+   dir_readdir(), each bucket is read only once.  Returns the
+   number of bytes stored, which is 0 at the end of the
+   directory, or -1 if the next entry does not fit or a disk or
+   memory error occurs. */
+off_t dir_getdents(struct dir* dir, void* buffer, size_t size) {
+  struct dir_bucket* bucket;
+  uint16_t bucket_cnt;
+  size_t used = 0;
+
+  bucket = malloc(sizeof *bucket);
+  if (bucket == NULL || inode_read_at(dir->inode, &bucket_cnt, sizeof bucket_cnt,
+                                      offsetof(struct dir_header, bucket_cnt)) != sizeof bucket_cnt) {
+    free(bucket);
+    return -1;
+  }
+
+  while ((size_t)dir->pos < bucket_cnt * BUCKET_ENTRIES) {
+    size_t slot;
+
+    if (inode_read_at(dir->inode, bucket, sizeof *bucket, bucket_ofs(dir->pos / BUCKET_ENTRIES)) !=
+        sizeof *bucket)
+      break;
+    for (slot = dir->pos % BUCKET_ENTRIES; slot < BUCKET_ENTRIES; slot++, dir->pos++) {
+      const struct dir_entry* e = &bucket->entries[slot];
+      struct dirent* d = (struct dirent*)((uint8_t*)buffer + used);
+      size_t reclen;
+
+      if (!e->in_use)
+        continue;
+      reclen = ROUND_UP(offsetof(struct dirent, d_name) + strlen(e->name) + 1, 4);
+      if (used + reclen > size)
+        goto done;
+      d->d_ino = e->inode_sector;
+      d->d_reclen = reclen;
+      d->d_type = e->is_dir ? DT_DIR : DT_REG;
+      strlcpy(d->d_name, e->name, NAME_MAX + 1);
+      used += reclen;
+    }
+  }
+
+done:
+  free(bucket);
+  if (used == 0 && (size_t)dir->pos < bucket_cnt * BUCKET_ENTRIES)
+    return -1;
+  return used;
+}
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -14,17 +15,20 @@
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create(block_sector_t sector, size_t entry_cnt);
+bool dir_create(block_sector_t sector, block_sector_t parent, size_t entry_cnt);
 struct dir* dir_open(struct inode*);
 struct dir* dir_open_root(void);
 struct dir* dir_reopen(struct dir*);
 void dir_close(struct dir*);
 struct inode* dir_get_inode(struct dir*);
+void dir_seek(struct dir*, off_t);
+off_t dir_tell(const struct dir*);
 
 /* Reading and writing. */
 bool dir_lookup(const struct dir*, const char* name, struct inode**);
-bool dir_add(struct dir*, const char* name, block_sector_t);
+bool dir_add(struct dir*, const char* name, block_sector_t, bool is_dir);
 bool dir_remove(struct dir*, const char* name);
 bool dir_readdir(struct dir*, char name[NAME_MAX + 1]);
+off_t dir_getdents(struct dir*, void* buffer, size_t size);
 
 #endif /* filesys/directory.h */
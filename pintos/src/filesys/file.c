@@ -1,13 +1,27 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Read-ahead window, in sectors.  A file read sequentially
+   prefetches RA_MIN sectors past each read at first, doubling
+   with each further sequential read up to RA_MAX; a read
+   anywhere else halves the window. */
+#define RA_MIN 2
+#define RA_MAX 16
 
 /* An open file. */
 struct file {
-  struct inode* inode; /* File's inode. */
-  off_t pos;           /* Current position. */
-  bool deny_write;     /* Has file_deny_write() been called? */
+  struct inode* inode;  /* File's inode. */
+  int ref_cnt;          /* References; see file_hold(). */
+  off_t pos;            /* Current position. */
+  struct lock pos_lock; /* Serializes reads and writes at pos. */
+  bool deny_write;      /* Has file_deny_write() been called? */
+  off_t ra_next;        /* Where the next sequential read starts. */
+  off_t ra_end;         /* End of the bytes already prefetched. */
+  int ra_window;        /* Sectors to prefetch ahead, 0 if none. */
 };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -17,8 +31,12 @@ struct file* file_open(struct inode* inode) {
   struct file* file = calloc(1, sizeof *file);
   if (inode != NULL && file != NULL) {
     file->inode = inode;
+    file->ref_cnt = 1;
     file->pos = 0;
+    lock_init(&file->pos_lock);
     file->deny_write = false;
+    file->ra_next = file->ra_end = 0;
+    file->ra_window = 0;
     return file;
   } else {
     inode_close(inode);
@@ -33,9 +51,26 @@ struct file* file_reopen(struct file* file) {
   return file_open(inode_reopen(file->inode));
 }
 
-/* Closes FILE. */
+/* Adds a reference to FILE and returns FILE, so that it stays
+   open, with the same position, until file_close() is called
+   once more than before.  This lets a thread keep using a file
+   that another thread closes meanwhile. */
+struct file* file_hold(struct file* file) {
+  enum intr_level old_level = intr_disable();
+  file->ref_cnt++;
+  intr_set_level(old_level);
+  return file;
+}
+
+/* Drops a reference to FILE, closing it if that was the last. */
 void file_close(struct file* file) {
   if (file != NULL) {
+    enum intr_level old_level = intr_disable();
+    bool last = --file->ref_cnt == 0;
+    intr_set_level(old_level);
+
+    if (!last)
+      return;
     file_allow_write(file);
     inode_close(file->inode);
     free(file);
@@ -47,14 +82,52 @@ struct inode* file_get_inode(struct file* file) {
   return file->inode;
 }
 
+/* Updates FILE's read-ahead window for a read of SIZE bytes at
+   its current position and starts prefetching the part of the
+   window not yet asked for, so that the disk fetches it while
+   the caller consumes this read. */
+static void read_ahead(struct file* file, off_t size) {
+  off_t end = file->pos + size;
+  off_t window_end;
+
+  if (file->pos == file->ra_next) {
+    file->ra_window = file->ra_window == 0 ? RA_MIN : file->ra_window * 2;
+    if (file->ra_window > RA_MAX)
+      file->ra_window = RA_MAX;
+  } else {
+    file->ra_window /= 2;
+    file->ra_end = 0;
+  }
+  if (file->ra_window == 0)
+    return;
+
+  window_end = end + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (file->ra_end < end)
+    file->ra_end = end;
+  if (file->ra_end < window_end) {
+    inode_read_ahead(file->inode, file->ra_end, window_end);
+    file->ra_end = window_end;
+  }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   Threads sharing FILE take turns, so that each one reads from
+   where the last left off.  Sequential reads prefetch the data
+   that follows. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
-  off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  lock_acquire(&file->pos_lock);
+  if (size > 0)
+    read_ahead(file, size);
+  bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->ra_next = file->pos;
+  lock_release(&file->pos_lock);
   return bytes_read;
 }
 
@@ -70,27 +143,73 @@ off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the disk fills up or writes to
+   FILE are denied.  Writing past end of file grows the file.
+   Advances FILE's position by the number of bytes written. */
 off_t file_write(struct file* file, const void* buffer, off_t size) {
-  off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  lock_acquire(&file->pos_lock);
+  bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
+  lock_release(&file->pos_lock);
   return bytes_written;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up or writes to
+   FILE are denied.  Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs) {
   return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
+/* Allocates disk space for SIZE bytes of FILE starting at offset
+   FILE_OFS, extending FILE if need be, so that writing there
+   later does not allocate.  Sets *CONTIGUOUS to whether those
+   bytes are consecutive on disk.  Returns true if successful,
+   false if the disk is full or writes to FILE are denied.
+   The file's current position is unaffected. */
+bool file_allocate(struct file* file, off_t file_ofs, off_t size, bool* contiguous) {
+  return inode_allocate(file->inode, file_ofs, size, contiguous);
+}
+
+/* Copies SIZE bytes from IN to OUT, each starting at its file's
+   current position, without passing them through user memory.
+   Holes in IN stay holes in OUT where possible.  Returns the
+   number of bytes copied, which may be less than SIZE if end of
+   IN is reached or the disk fills up, and advances both
+   positions by that much.  Returns -1 without copying if IN and
+   OUT are the same inode and the two ranges overlap. */
+off_t file_copy(struct file* in, struct file* out, off_t size) {
+  struct file* first = in < out ? in : out;
+  struct file* second = in < out ? out : in;
+  off_t bytes_copied;
+
+  /* Lock both positions, in a fixed order to avoid deadlock. */
+  lock_acquire(&first->pos_lock);
+  if (second != first)
+    lock_acquire(&second->pos_lock);
+
+  /* Compare in 64 bits, since a position plus SIZE may overflow
+     off_t. */
+  if (in->inode == out->inode && size > 0 && (int64_t)in->pos < (int64_t)out->pos + size &&
+      (int64_t)out->pos < (int64_t)in->pos + size)
+    bytes_copied = -1;
+  else {
+    bytes_copied = inode_copy_range(in->inode, in->pos, out->inode, out->pos, size);
+    in->pos += bytes_copied;
+    out->pos += bytes_copied;
+  }
+
+  if (second != first)
+    lock_release(&second->pos_lock);
+  lock_release(&first->pos_lock);
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void file_deny_write(struct file* file) {
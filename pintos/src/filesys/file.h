@@ -1,6 +1,7 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
@@ -8,6 +9,7 @@ struct inode;
 /* Opening and closing files. */
 struct file* file_open(struct inode*);
 struct file* file_reopen(struct file*);
+struct file* file_hold(struct file*);
 void file_close(struct file*);
 struct inode* file_get_inode(struct file*);
 
@@ -16,6 +18,8 @@ off_t file_read(struct file*, void*, off_t);
 off_t file_read_at(struct file*, void*, off_t size, off_t start);
 off_t file_write(struct file*, const void*, off_t);
 off_t file_write_at(struct file*, const void*, off_t size, off_t start);
+bool file_allocate(struct file*, off_t start, off_t size, bool* contiguous);
+off_t file_copy(struct file* in, struct file* out, off_t size);
 
 /* Preventing writes. */
 void file_deny_write(struct file*);
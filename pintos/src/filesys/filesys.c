@@ -2,10 +2,18 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/log.h"
+#include "filesys/vfs.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block* fs_device;
@@ -19,18 +27,120 @@ void filesys_init(bool format) {
   if (fs_device == NULL)
     PANIC("No file system device found, can't initialize file system.");
 
+  cache_init();
+  dcache_init();
   inode_init();
+  vfs_init();
   free_map_init();
 
   if (format)
     do_format();
+  log_init(format);
 
   free_map_open();
 }
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
-void filesys_done(void) { free_map_close(); }
+void filesys_done(void) {
+  inode_flush();
+  log_commit();
+  free_map_close();
+  cache_flush();
+}
+
+/* Places delayed appends, commits the file system's journaled
+   metadata, and writes dirty buffers to disk. */
+void filesys_sync(void) {
+  inode_flush();
+  log_commit();
+  cache_flush();
+}
+
+/* Returns the directory from which PATH is resolved: the root
+   directory if PATH is absolute or there is no running process,
+   otherwise the process's working directory.  The caller must
+   close it. */
+static struct dir* open_start(const char* path) {
+#ifdef USERPROG
+  struct process* pcb = thread_current()->pcb;
+  if (*path != '/' && pcb != NULL && pcb->cwd != NULL)
+    return dir_reopen(pcb->cwd);
+#endif
+  return dir_open_root();
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int get_next_part(char part[NAME_MAX + 1], const char** srcp) {
+  const char* src = *srcp;
+  char* dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') {
+    if (dst < part + NAME_MAX)
+      *dst++ = *src;
+    else
+      return -1;
+    src++;
+  }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Resolves PATH up to its last component, which is stored in
+   NAME, and returns the directory that component is to be found
+   in, which the caller must close.  A PATH of only slashes names
+   the root directory as "." within itself.  Returns a null
+   pointer if PATH is empty, if a component is too long, or if a
+   component other than the last does not exist or is not a
+   directory. */
+static struct dir* resolve(const char* path, char name[NAME_MAX + 1]) {
+  struct dir* dir;
+  bool have_name = false;
+  char part[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  dir = open_start(path);
+  strlcpy(name, ".", NAME_MAX + 1);
+  while (dir != NULL && (result = get_next_part(part, &path)) != 0) {
+    struct inode* inode;
+
+    if (result < 0) {
+      dir_close(dir);
+      return NULL;
+    }
+
+    /* The previous component must be a directory to descend
+       into. */
+    if (have_name) {
+      if (!dir_lookup(dir, name, &inode) || !inode_is_dir(inode)) {
+        inode_close(inode);
+        dir_close(dir);
+        return NULL;
+      }
+      dir_close(dir);
+      dir = dir_open(inode);
+    }
+    strlcpy(name, part, NAME_MAX + 1);
+    have_name = true;
+  }
+  return dir;
+}
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
@@ -38,40 +148,108 @@ void filesys_done(void) { free_map_close(); }
    or if internal memory allocation fails. */
 bool filesys_create(const char* name, off_t initial_size) {
   block_sector_t inode_sector = 0;
-  struct dir* dir = dir_open_root();
-  bool success = (dir != NULL && free_map_allocate(1, &inode_sector) &&
-                  inode_create(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
+  char part[NAME_MAX + 1];
+  struct dir* dir;
+  bool success;
+
+  log_begin_op();
+  dir = resolve(name, part);
+  success = (dir != NULL &&
+             inode_alloc_inumber(dir_get_inode(dir), &inode_sector) &&
+             inode_create(inode_sector, initial_size, INODE_REGULAR) &&
+             dir_add(dir, part, inode_sector, false));
   if (!success && inode_sector != 0)
-    free_map_release(inode_sector, 1);
+    inode_free_inumber(inode_sector);
   dir_close(dir);
+  log_end_op();
 
   return success;
 }
 
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists, if its parent does
+   not exist, or if internal memory allocation fails. */
+bool filesys_mkdir(const char* name) {
+  block_sector_t inode_sector = 0;
+  char part[NAME_MAX + 1];
+  struct dir* dir;
+  bool success;
+
+  log_begin_op();
+  dir = resolve(name, part);
+  success = (dir != NULL &&
+             inode_alloc_inumber(dir_get_inode(dir), &inode_sector) &&
+             dir_create(inode_sector, inode_get_inumber(dir_get_inode(dir)), 16));
+  if (success && !dir_add(dir, part, inode_sector, true)) {
+    /* Free the new directory's sectors along with its inode. */
+    struct inode* inode = inode_open(inode_sector);
+    if (inode != NULL)
+      inode_remove(inode);
+    inode_close(inode);
+    success = false;
+  } else if (!success && inode_sector != 0)
+    inode_free_inumber(inode_sector);
+  dir_close(dir);
+  log_end_op();
+
+  return success;
+}
+
+/* Opens the inode of the file or directory with the given NAME,
+   which the caller must close.  Returns a null pointer if there
+   is none. */
+static struct inode* open_inode(const char* name) {
+  char part[NAME_MAX + 1];
+  struct dir* dir = resolve(name, part);
+  struct inode* inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup(dir, part, &inode);
+  dir_close(dir);
+  return inode;
+}
+
 /* Opens the file with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   or if an internal memory allocation fails.
+   NAME may be a directory, whose file may not be read or
+   written but identifies it to inode_is_dir() and the like. */
 struct file* filesys_open(const char* name) {
-  struct dir* dir = dir_open_root();
-  struct inode* inode = NULL;
+  return file_open(open_inode(name));
+}
 
-  if (dir != NULL)
-    dir_lookup(dir, name, &inode);
-  dir_close(dir);
+/* Opens the directory with the given NAME.
+   Returns the new directory if successful or a null pointer
+   otherwise.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+struct dir* filesys_open_dir(const char* name) {
+  struct inode* inode = open_inode(name);
 
-  return file_open(inode);
+  if (inode != NULL && !inode_is_dir(inode)) {
+    inode_close(inode);
+    return NULL;
+  }
+  return dir_open(inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if it is a directory that
+   is not empty, or if an internal memory allocation fails. */
 bool filesys_remove(const char* name) {
-  struct dir* dir = dir_open_root();
-  bool success = dir != NULL && dir_remove(dir, name);
+  char part[NAME_MAX + 1];
+  struct dir* dir;
+  bool success;
+
+  log_begin_op();
+  dir = resolve(name, part);
+  success = dir != NULL && dir_remove(dir, part);
   dir_close(dir);
+  log_end_op();
 
   return success;
 }
@@ -80,7 +258,7 @@ bool filesys_remove(const char* name) {
 static void do_format(void) {
   printf("Formatting file system...");
   free_map_create();
-  if (!dir_create(ROOT_DIR_SECTOR, 16))
+  if (!dir_create(ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC("root directory creation failed");
   free_map_close();
   printf("done.\n");
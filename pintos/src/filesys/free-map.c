@@ -1,43 +1,428 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/log.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
+static struct lock free_map_lock;  /* Protects the free map. */
+
+/* Sectors of the free map file that differ from the in-memory
+   free map, one bit per sector.
+
+   Allocating or releasing sectors only marks the affected part
+   of the file dirty; free_map_flush() writes the dirty sectors
+   out when the journal commits a transaction and when the free
+   map is closed.  The free map on disk thus changes together
+   with the inodes and directories that use its sectors. */
+static struct bitmap* dirty_sectors;
+
+/* Sectors released since the last commit.  They are marked free
+   in the bitmap, so that the free map written with the releasing
+   transaction shows them free, but they only return to the free
+   extents once free_map_commit() is called after that
+   transaction has committed.  Until then the metadata on disk
+   may still point to them, so they must not be reused. */
+static struct bitmap* released;
+static size_t released_cnt; /* Number of sectors in RELEASED. */
+static size_t released_min; /* No sector before this is in RELEASED. */
+
+/* Serializes free_map_flush(), which writes without holding
+   free_map_lock. */
+static struct lock flush_lock;
+
+/* The bitmap is the free map's on-disk form.  In memory, free
+   space is also kept as a list of extents, maximal runs of free
+   sectors, in an array sorted by address, so that an allocation
+   can quickly find free space at or after a goal sector.  Counts
+   of extents by size class let a request that no extent can
+   satisfy fail without scanning. */
+struct extent {
+  block_sector_t start; /* First free sector. */
+  block_sector_t cnt;   /* Number of free sectors. */
+};
+
+#define SIZE_CLASSES FSSTAT_CLASSES /* Size class of N is floor(log2(N)). */
+
+static struct extent* extents; /* Free extents, by address. */
+static size_t extent_cnt;      /* Number of free extents. */
+static size_t class_cnt[SIZE_CLASSES]; /* Free extents per class. */
+
+/* Free space may also be reserved without choosing where it is,
+   for data whose placement is delayed.  Reserved sectors count
+   as used to ordinary allocations, which thus cannot take space
+   that was promised to someone else. */
+static size_t free_cnt;     /* Number of free sectors. */
+static size_t reserved_cnt; /* Number of them reserved. */
+
+/* Returns the size class of an extent of CNT sectors. */
+static int size_class(block_sector_t cnt) {
+  int class = 0;
+
+  ASSERT(cnt > 0);
+  while (cnt >>= 1)
+    class++;
+  return class;
+}
+
+/* Returns true if some free extent might hold CNT sectors. */
+static bool might_fit(size_t cnt) {
+  int class;
+
+  for (class = size_class(cnt); class < SIZE_CLASSES; class++)
+    if (class_cnt[class] > 0)
+      return true;
+  return false;
+}
+
+/* Returns the index of the first extent that ends after SECTOR,
+   or extent_cnt if there is none. */
+static size_t find_extent(block_sector_t sector) {
+  size_t lo = 0, hi = extent_cnt;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (extents[mid].start + extents[mid].cnt <= sector)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Inserts an extent of CNT sectors at START as index IDX. */
+static void insert_extent(size_t idx, block_sector_t start, block_sector_t cnt) {
+  memmove(&extents[idx + 1], &extents[idx], (extent_cnt - idx) * sizeof *extents);
+  extents[idx].start = start;
+  extents[idx].cnt = cnt;
+  extent_cnt++;
+  class_cnt[size_class(cnt)]++;
+}
+
+/* Removes extent IDX. */
+static void remove_extent(size_t idx) {
+  class_cnt[size_class(extents[idx].cnt)]--;
+  memmove(&extents[idx], &extents[idx + 1], (extent_cnt - idx - 1) * sizeof *extents);
+  extent_cnt--;
+}
+
+/* Changes extent IDX to CNT sectors starting at START. */
+static void resize_extent(size_t idx, block_sector_t start, block_sector_t cnt) {
+  class_cnt[size_class(extents[idx].cnt)]--;
+  extents[idx].start = start;
+  extents[idx].cnt = cnt;
+  class_cnt[size_class(cnt)]++;
+}
+
+/* Takes CNT sectors starting at SECTOR out of extent IDX, which
+   must contain them. */
+static void carve_extent(size_t idx, block_sector_t sector, size_t cnt) {
+  struct extent e = extents[idx];
+  block_sector_t end = e.start + e.cnt;
+
+  ASSERT(sector >= e.start && sector + cnt <= end);
+  if (sector == e.start && cnt == e.cnt)
+    remove_extent(idx);
+  else if (sector == e.start)
+    resize_extent(idx, sector + cnt, e.cnt - cnt);
+  else {
+    resize_extent(idx, e.start, sector - e.start);
+    if (sector + cnt < end)
+      insert_extent(idx + 1, sector + cnt, end - (sector + cnt));
+  }
+}
+
+/* Returns CNT sectors starting at SECTOR to the free extents,
+   merging them with their neighbors. */
+static void add_free(block_sector_t sector, size_t cnt) {
+  size_t idx = find_extent(sector);
+  bool merge_prev = idx > 0 && extents[idx - 1].start + extents[idx - 1].cnt == sector;
+  bool merge_next = idx < extent_cnt && extents[idx].start == sector + cnt;
+
+  if (merge_prev && merge_next) {
+    resize_extent(idx - 1, extents[idx - 1].start, extents[idx - 1].cnt + cnt + extents[idx].cnt);
+    remove_extent(idx);
+  } else if (merge_prev)
+    resize_extent(idx - 1, extents[idx - 1].start, extents[idx - 1].cnt + cnt);
+  else if (merge_next)
+    resize_extent(idx, sector, extents[idx].cnt + cnt);
+  else
+    insert_extent(idx, sector, cnt);
+}
+
+/* Rebuilds the free extents from the bitmap. */
+static void build_extents(void) {
+  size_t size = bitmap_size(free_map);
+  size_t start = 0;
+
+  extent_cnt = 0;
+  free_cnt = 0;
+  memset(class_cnt, 0, sizeof class_cnt);
+  for (;;) {
+    size_t end;
+
+    start = bitmap_scan(free_map, start, 1, false);
+    if (start == BITMAP_ERROR)
+      break;
+    end = bitmap_scan(free_map, start, 1, true);
+    if (end == BITMAP_ERROR)
+      end = size;
+    insert_extent(extent_cnt, start, end - start);
+    free_cnt += end - start;
+    start = end;
+  }
+}
+
+/* Marks dirty the sectors of the free map file holding the bits
+   for CNT sectors starting at SECTOR. */
+static void mark_dirty(block_sector_t sector, size_t cnt) {
+  size_t first = sector / 8 / BLOCK_SECTOR_SIZE;
+  size_t last = (sector + cnt - 1) / 8 / BLOCK_SECTOR_SIZE;
+
+  bitmap_set_multiple(dirty_sectors, first, last - first + 1, true);
+}
 
 /* Initializes the free map. */
 void free_map_init(void) {
-  free_map = bitmap_create(block_size(fs_device));
+  size_t sectors = block_size(fs_device);
+
+  lock_init(&free_map_lock);
+  lock_init(&flush_lock);
+  free_map = bitmap_create(sectors);
   if (free_map == NULL)
     PANIC("bitmap creation failed--file system device is too large");
+  dirty_sectors = bitmap_create(DIV_ROUND_UP(bitmap_file_size(free_map), BLOCK_SECTOR_SIZE));
+  released = bitmap_create(sectors);
+  if (dirty_sectors == NULL || released == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  released_min = sectors;
+
+  /* Free and used sectors alternate at worst. */
+  extents = malloc((sectors / 2 + 1) * sizeof *extents);
+  if (extents == NULL)
+    PANIC("free extent allocation failed--file system device is too large");
+
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple(free_map, LOG_SECTOR, log_sectors(), true);
+  build_extents();
+}
+
+/* Finds CNT consecutive free sectors as free_map_allocate_near()
+   would allocate them, without allocating them.  Stores the first
+   into *SECTORP and the index of the extent holding them into
+   *IDXP.  Returns false if there are no such sectors.
+   free_map_lock must be held. */
+static bool find_space(block_sector_t goal, size_t cnt, size_t* idxp, block_sector_t* sectorp) {
+  size_t first, i;
+
+  ASSERT(lock_held_by_current_thread(&free_map_lock));
+  first = find_extent(goal);
+  for (i = might_fit(cnt) ? 0 : extent_cnt; i < extent_cnt; i++) {
+    size_t idx = (first + i) % extent_cnt;
+    struct extent* e = &extents[idx];
+
+    if (goal >= e->start && goal + cnt <= e->start + e->cnt)
+      *sectorp = goal;
+    else if (e->cnt >= cnt)
+      *sectorp = e->start;
+    else
+      continue;
+    *idxp = idx;
+    return true;
+  }
+  return false;
+}
+
+/* Allocates as free_map_allocate_near() does, taking the sectors
+   out of space reserved earlier with free_map_reserve() if
+   RESERVED is true, otherwise out of unreserved space. */
+static bool allocate(block_sector_t goal, size_t cnt, block_sector_t* sectorp, bool reserved) {
+  block_sector_t sector = 0;
+  bool found;
+  size_t idx;
+
+  if (cnt == 0)
+    return false;
+
+  lock_acquire(&free_map_lock);
+  ASSERT(!reserved || reserved_cnt >= cnt);
+  if (!reserved && free_cnt - reserved_cnt < cnt) {
+    lock_release(&free_map_lock);
+    return false;
+  }
+  found = find_space(goal, cnt, &idx, &sector);
+  if (found) {
+    carve_extent(idx, sector, cnt);
+    bitmap_set_multiple(free_map, sector, cnt, true);
+    mark_dirty(sector, cnt);
+    free_cnt -= cnt;
+    if (reserved)
+      reserved_cnt -= cnt;
+    *sectorp = sector;
+  }
+  lock_release(&free_map_lock);
+  return found;
+}
+
+/* Allocates CNT consecutive sectors from the free map, as close
+   after sector GOAL as possible, and stores the first into
+   *SECTORP.  The sectors start at GOAL itself if it is free,
+   otherwise at the start of the next free extent that holds
+   them, wrapping around to the start of the disk if need be.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool free_map_allocate_near(block_sector_t goal, size_t cnt, block_sector_t* sectorp) {
+  return allocate(goal, cnt, sectorp, false);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
-  }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  return free_map_allocate_near(0, cnt, sectorp);
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Frees CNT sectors starting at SECTOR.  They become available
+   for use once the running transaction commits. */
 void free_map_release(block_sector_t sector, size_t cnt) {
+  lock_acquire(&free_map_lock);
   ASSERT(bitmap_all(free_map, sector, cnt));
   bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  bitmap_set_multiple(released, sector, cnt, true);
+  mark_dirty(sector, cnt);
+  released_cnt += cnt;
+  if (sector < released_min)
+    released_min = sector;
+  lock_release(&free_map_lock);
+}
+
+/* Makes the sectors released so far available for use.  Called
+   by the journal once every transaction that released them has
+   committed and been written home. */
+void free_map_commit(void) {
+  size_t start;
+
+  lock_acquire(&free_map_lock);
+  for (start = released_min; released_cnt > 0;) {
+    size_t end;
+
+    start = bitmap_scan(released, start, 1, true);
+    ASSERT(start != BITMAP_ERROR);
+    end = bitmap_scan(released, start, 1, false);
+    if (end == BITMAP_ERROR)
+      end = bitmap_size(released);
+    bitmap_set_multiple(released, start, end - start, false);
+    add_free(start, end - start);
+    free_cnt += end - start;
+    released_cnt -= end - start;
+    start = end;
+  }
+  released_min = bitmap_size(released);
+  lock_release(&free_map_lock);
+}
+
+/* Finds CNT consecutive free sectors where
+   free_map_allocate_near() would allocate them for GOAL, and
+   stores the first into *SECTORP, but leaves them free.  Returns
+   false if not enough consecutive unreserved sectors are
+   available. */
+bool free_map_find(block_sector_t goal, size_t cnt, block_sector_t* sectorp) {
+  size_t idx;
+  bool found;
+
+  if (cnt == 0)
+    return false;
+  lock_acquire(&free_map_lock);
+  found = free_cnt - reserved_cnt >= cnt && find_space(goal, cnt, &idx, sectorp);
+  lock_release(&free_map_lock);
+  return found;
+}
+
+/* Stores a summary of the free space into *STATS: how much there
+   is and how it is broken up into extents. */
+void free_map_stats(struct fsstat* stats) {
+  size_t i;
+
+  lock_acquire(&free_map_lock);
+  stats->free_sectors = free_cnt;
+  stats->reserved_sectors = reserved_cnt;
+  stats->free_extents = extent_cnt;
+  stats->largest_extent = 0;
+  for (i = 0; i < extent_cnt; i++)
+    if (extents[i].cnt > stats->largest_extent)
+      stats->largest_extent = extents[i].cnt;
+  for (i = 0; i < SIZE_CLASSES; i++)
+    stats->extents[i] = class_cnt[i];
+  lock_release(&free_map_lock);
+}
+
+/* Reserves CNT free sectors, to be allocated later with
+   free_map_allocate_reserved() or given back with
+   free_map_unreserve().  Returns false if fewer than CNT
+   unreserved sectors are free. */
+bool free_map_reserve(size_t cnt) {
+  bool success;
+
+  lock_acquire(&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release(&free_map_lock);
+  return success;
+}
+
+/* Gives back CNT sectors reserved with free_map_reserve(). */
+void free_map_unreserve(size_t cnt) {
+  lock_acquire(&free_map_lock);
+  ASSERT(reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release(&free_map_lock);
+}
+
+/* Allocates CNT consecutive sectors, as free_map_allocate_near()
+   does, out of sectors reserved with free_map_reserve().  Returns
+   false if they are not available consecutively; reserved
+   sectors are always available one at a time. */
+bool free_map_allocate_reserved(block_sector_t goal, size_t cnt, block_sector_t* sectorp) {
+  return allocate(goal, cnt, sectorp, true);
+}
+
+/* Writes the dirty sectors of the free map to disk.  Each one is
+   copied under free_map_lock but written without it, since
+   writing takes the free map file's data_lock, which comes first
+   in the lock order. */
+void free_map_flush(void) {
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  if (free_map_file == NULL)
+    return;
+
+  lock_acquire(&flush_lock);
+  for (i = 0; i < bitmap_size(dirty_sectors); i++) {
+    off_t ofs = i * BLOCK_SECTOR_SIZE;
+    off_t size = 0;
+
+    lock_acquire(&free_map_lock);
+    if (bitmap_test(dirty_sectors, i)) {
+      size = bitmap_copy_part(free_map, buffer, ofs, BLOCK_SECTOR_SIZE);
+      bitmap_reset(dirty_sectors, i);
+    }
+    lock_release(&free_map_lock);
+
+    if (size > 0 && file_write_at(free_map_file, buffer, size, ofs) != size)
+      PANIC("can't write free map");
+  }
+  lock_release(&flush_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -47,22 +432,32 @@ void free_map_open(void) {
     PANIC("can't open free map");
   if (!bitmap_read(free_map, free_map_file))
     PANIC("can't read free map");
+  build_extents();
+  bitmap_set_all(dirty_sectors, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
-void free_map_close(void) { file_close(free_map_file); }
+void free_map_close(void) {
+  free_map_flush();
+  file_close(free_map_file);
+  free_map_file = NULL;
+}
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void free_map_create(void) {
   /* Create inode. */
-  if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map)))
+  if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), INODE_SYSTEM))
     PANIC("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write bitmap to file.  This allocates the file's sectors,
+     which changes the bitmap as it is written, so every sector
+     is left dirty for the next flush to write again.  Afterward
+     the file has no holes, so flushing never allocates. */
   free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  bitmap_set_all(dirty_sectors, true);
 }
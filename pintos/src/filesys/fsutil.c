@@ -7,6 +7,8 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -26,6 +28,86 @@ void fsutil_ls(char** argv UNUSED) {
   printf("End of listing.\n");
 }
 
+/* Longest path printed by the fragmentation report. */
+#define PATH_MAX 128
+
+/* Prints the number of fragments of each file under DIR, whose
+   path is the LEN bytes at PATH, after moving each into a
+   single fragment if DEFRAG is true. */
+static void walk_tree(struct dir* dir, char path[PATH_MAX], size_t len, bool defrag) {
+  char name[NAME_MAX + 1];
+
+  while (dir_readdir(dir, name)) {
+    struct inode* inode;
+
+    if (len + 1 + strlen(name) >= PATH_MAX || !dir_lookup(dir, name, &inode))
+      continue;
+    snprintf(path + len, PATH_MAX - len, "/%s", name);
+
+    if (inode_is_dir(inode)) {
+      struct dir* subdir = dir_open(inode);
+      if (subdir != NULL) {
+        walk_tree(subdir, path, strlen(path), defrag);
+        dir_close(subdir);
+      }
+    } else {
+      int fragment_cnt = inode_fragments(inode);
+
+      if (!defrag)
+        printf("%s: %d fragments\n", path, fragment_cnt);
+      else if (inode_defragment(inode))
+        printf("%s: %d -> %d fragments\n", path, fragment_cnt, inode_fragments(inode));
+      else
+        printf("%s: %d fragments, no room to move\n", path, fragment_cnt);
+      inode_close(inode);
+    }
+  }
+  path[len] = '\0';
+}
+
+/* Prints how free space is broken up. */
+static void print_free_space(void) {
+  struct fsstat stats;
+  int class;
+
+  free_map_stats(&stats);
+  printf("Free space: %u sectors (%u reserved) in %u extents, largest %u sectors.\n",
+         stats.free_sectors, stats.reserved_sectors, stats.free_extents, stats.largest_extent);
+  for (class = 0; class < FSSTAT_CLASSES; class++)
+    if (stats.extents[class] > 0)
+      printf("  %u-%u sectors: %u extents\n", 1u << class, (2u << class) - 1,
+             stats.extents[class]);
+}
+
+/* Reports the fragmentation of every file and of free space. */
+void fsutil_frag(char** argv UNUSED) {
+  char path[PATH_MAX] = "";
+  struct dir* dir;
+
+  printf("Fragmentation report:\n");
+  dir = dir_open_root();
+  if (dir == NULL)
+    PANIC("root dir open failed");
+  walk_tree(dir, path, 0, false);
+  dir_close(dir);
+  print_free_space();
+}
+
+/* Moves every file into a single run of sectors, where there is
+   room, and reports the result.  Files stay in use meanwhile. */
+void fsutil_defrag(char** argv UNUSED) {
+  char path[PATH_MAX] = "";
+  struct dir* dir;
+
+  printf("Defragmenting files...\n");
+  dir = dir_open_root();
+  if (dir == NULL)
+    PANIC("root dir open failed");
+  walk_tree(dir, path, 0, true);
+  dir_close(dir);
+  print_free_space();
+}
+
 /* Prints the contents of file ARGV[1] to the system console as
    hex and ASCII. */
 void fsutil_cat(char** argv) {
@@ -97,8 +179,11 @@ void fsutil_extract(char** argv UNUSED) {
     if (type == USTAR_EOF) {
       /* End of archive. */
       break;
-    } else if (type == USTAR_DIRECTORY)
-      printf("ignoring directory %s\n", file_name);
+    } else if (type == USTAR_DIRECTORY) {
+      printf("Putting directory '%s' into the file system...\n", file_name);
+      if (!filesys_mkdir(file_name))
+        PANIC("%s: mkdir failed", file_name);
+    }
     else if (type == USTAR_REGULAR) {
       struct file* dst;
 
@@ -1,63 +1,538 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/log.h"
+#include "filesys/vfs.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector pointers in an inode and in an index block. */
+#define DIRECT_CNT 120
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+/* Sectors reachable through each level of the index. */
+#define INDIRECT_CNT PTRS_PER_SECTOR
+#define DOUBLY_INDIRECT_CNT (PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + DOUBLY_INDIRECT_CNT)
+
+/* Set in a data sector pointer whose sector is allocated but
+   has never been written, so that it reads as zeros.  See
+   inode_allocate(). */
+#define UNWRITTEN 0x80000000u
+
+/* Largest file kept inline in its inode. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof(block_sector_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   Data sectors are found through a multilevel index: the first
+   DIRECT_CNT sectors directly, the next INDIRECT_CNT through the
+   index block at INDIRECT, and the rest through the index blocks
+   listed in the index block at DOUBLY_INDIRECT.  A pointer of
+   zero is a hole: no sector is allocated and the data reads as
+   zeros.  (Sector 0 holds the free map's inode, so it is never a
+   data sector.)
+
+   A file of at most INLINE_MAX bytes is instead stored inline,
+   in the space of the index itself, with INODE_INLINE set in
+   FLAGS, so that it takes up a single sector.  It moves to a data
+   sector when a write extends it past INLINE_MAX bytes.
+
+   Inodes and index blocks are journaled.  So is the data of an
+   inode with INODE_META set, one holding file system metadata:
+   a directory or the free map. */
 struct inode_disk {
-  block_sector_t start; /* First data sector. */
-  off_t length;         /* File size in bytes. */
-  unsigned magic;       /* Magic number. */
-  uint32_t unused[125]; /* Not used. */
+  union {
+    struct {
+      block_sector_t direct[DIRECT_CNT]; /* Direct data sectors. */
+      block_sector_t indirect;           /* Index block of data sectors. */
+      block_sector_t doubly_indirect;    /* Index block of index blocks. */
+    };
+    uint8_t inline_data[INLINE_MAX]; /* Data of an inline file. */
+  };
+  off_t length;       /* File size in bytes. */
+  unsigned magic;     /* Magic number. */
+  uint32_t flags;     /* INODE_* flags. */
+  uint32_t unused[3]; /* Not used. */
 };
 
+/* Inode flags. */
+#define INODE_INLINE 0x1 /* Data is in inline_data. */
+#define INODE_META 0x2   /* Data is journaled metadata. */
+#define INODE_DIR 0x4    /* Inode is a directory. */
+
+/* Most bytes of a file's data written in one journal operation:
+   few enough sectors, along with the index blocks that reach
+   them, to fit the operation's share of the journal. */
+#define WRITE_CHUNK(DISK) (((DISK)->flags & INODE_META ? 4 : 128) * BLOCK_SECTOR_SIZE)
+
+/* Most appended sectors whose placement is delayed at once, as
+   many as fit in the page that holds them. */
+#define PENDING_MAX (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most index blocks that placing PENDING_MAX consecutive sectors
+   may allocate: the indirect block, the doubly indirect block,
+   and one of its blocks, or the doubly indirect block and two of
+   its blocks. */
+#define PENDING_INDEX 3
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
 /* In-memory inode. */
 struct inode {
-  struct list_elem elem;  /* Element in inode list. */
-  block_sector_t sector;  /* Sector number of disk location. */
-  int open_cnt;           /* Number of openers. */
-  bool removed;           /* True if deleted, false otherwise. */
-  int deny_write_cnt;     /* 0: writes ok, >0: deny writes. */
-  struct inode_disk data; /* Inode content. */
+  struct hash_elem elem;     /* Element in inode_table. */
+  struct list_elem lru_elem; /* Element in closed_inodes, if closed. */
+  block_sector_t sector;     /* Inode number: sector on disk_fs. */
+  struct fs* fs;             /* File system the inode is on. */
+  void* aux;                 /* State kept by a file system other than disk_fs. */
+  int open_cnt;              /* Number of openers. */
+  bool removed;              /* True if deleted, false otherwise. */
+  struct lock lock;          /* Lock for the inode's user. */
+  struct rw_lock data_lock;  /* Protects the following. */
+  int deny_write_cnt;        /* 0: writes ok, >0: deny writes. */
+  struct inode_disk data;    /* Inode content. */
+  uint8_t* pending;          /* Appended data not yet placed, or NULL. */
+  size_t pending_start;      /* Index of first pending sector. */
+  size_t pending_cnt;        /* Number of pending sectors. */
+  bool pending_queued;       /* In pending_inodes? */
+  struct list_elem pending_elem; /* Element in pending_inodes. */
 };
 
+/* Delayed allocation.
+
+   Sectors appended to a regular file are not placed on disk as
+   they are written.  Instead, up to PENDING_MAX of them collect
+   in a page of memory, with space reserved in the free map for
+   them and for the index blocks that will reach them, and are
+   read back from there.  They are placed all
+   together, as one extent right after the file's previous
+   sector if possible, when the page fills, when the file is last
+   closed, and when the file system is synced.  A file written in
+   many small appends thus ends up contiguous even when other
+   files are written at the same time.
+
+   Pending sectors are holes in the file's index until placed,
+   and placing writes them to disk before the journaled index
+   points to them, so after a crash they read as zeros or as the
+   data written, never as a sector's earlier contents.
+
+   pending_inodes lists the inodes with pending sectors, so that
+   inode_flush() can find them.  pending_lock protects the list
+   and each inode's pending_queued; the rest of the pending state
+   is protected by the inode's data_lock. */
+static struct list pending_inodes;
+static struct lock pending_lock;
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR,
+   through the journal if META is true. */
+static void write_sector(bool meta, block_sector_t sector, const void* buffer, size_t ofs,
+                         size_t size) {
+  if (meta)
+    log_write(sector, buffer, ofs, size);
+  else
+    cache_write(sector, buffer, ofs, size);
+}
+
+/* Writes like write_sector(), to a sector that the journaled
+   index is about to point to for the first time, or to mark
+   written.  Unless the sector is journaled itself, it reaches the
+   disk before this returns, so that the index never reaches the
+   disk ahead of it and a crash never exposes the sector's
+   earlier contents. */
+static void write_new_sector(bool meta, block_sector_t sector, const void* buffer, size_t ofs,
+                             size_t size) {
+  if (meta)
+    log_write(sector, buffer, ofs, size);
+  else
+    cache_write_through(sector, buffer, ofs, size);
+}
+
+/* A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Allocates a zeroed sector, as close after GOAL as possible,
+   and stores it in *SECTORP.  The zeros are journaled if META is
+   true, and otherwise written through to disk, as by
+   write_new_sector().  Returns false if the disk is full. */
+static bool allocate_zeroed(block_sector_t goal, block_sector_t* sectorp, bool meta) {
+  if (!free_map_allocate_near(goal, 1, sectorp))
+    return false;
+  write_new_sector(meta, *sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector that pointer *PTR refers to, first
+   allocating a zeroed one near GOAL if it is a hole and CREATE is
+   true, as allocate_zeroed() does with META.  Returns 0 for a
+   hole that is left alone or cannot be filled. */
+static block_sector_t get_ptr(block_sector_t* ptr, bool create, block_sector_t goal, bool meta) {
+  if (*ptr == 0 && create && !allocate_zeroed(goal, ptr, meta))
+    return 0;
+  return *ptr;
+}
+
+/* Returns the sector that entry IDX of index block BLOCK refers
+   to, allocating it as get_ptr() does. */
+static block_sector_t get_index_ptr(block_sector_t block, size_t idx, bool create,
+                                    block_sector_t goal, bool meta) {
+  block_sector_t ptr;
+  size_t ofs = idx * sizeof ptr;
+
+  cache_read(block, &ptr, ofs, sizeof ptr);
+  if (ptr == 0 && create && allocate_zeroed(goal, &ptr, meta))
+    log_write(block, &ptr, ofs, sizeof ptr);
+  return ptr;
+}
+
+static block_sector_t lookup_index(struct inode_disk*, size_t idx, bool create,
+                                   block_sector_t goal);
+
+/* Returns the sector after which to allocate data sector IDX of
+   DISK, whose inode is in sector HOME: the previous data sector,
+   or the inode itself for the first one. */
+static block_sector_t allocation_goal(struct inode_disk* disk, size_t idx, block_sector_t home) {
+  if (idx > 0) {
+    block_sector_t prev = lookup_index(disk, idx - 1, false, 0) & ~UNWRITTEN;
+    if (prev != 0)
+      return prev + 1;
+  }
+  return home + 1;
+}
+
+/* Returns the sector holding data sector IDX of DISK, whose inode
+   is in sector HOME, or 0 if it is a hole.  An unwritten sector
+   is returned with UNWRITTEN set.  If CREATE is true,
+   holes are filled with newly allocated zeroed sectors, along
+   with any index blocks needed to reach them; DISK's pointers are
+   updated in memory only, and 0 is returned if the disk is full.
+   New sectors go right after the previous data sector, or after
+   the inode for the first one, so that files written in pieces
+   still end up contiguous. */
+static block_sector_t index_to_sector(struct inode_disk* disk, size_t idx, block_sector_t home,
+                                      bool create) {
+  block_sector_t sector = lookup_index(disk, idx, false, 0);
+
+  if (sector != 0 || !create)
+    return sector;
+  return lookup_index(disk, idx, true, allocation_goal(disk, idx, home));
+}
+
+/* Walks DISK's index to data sector IDX, as index_to_sector()
+   does, allocating any missing sectors near GOAL if CREATE is
+   true. */
+static block_sector_t lookup_index(struct inode_disk* disk, size_t idx, bool create,
+                                   block_sector_t goal) {
+  bool meta = (disk->flags & INODE_META) != 0;
+  block_sector_t block;
+
+  if (idx < DIRECT_CNT)
+    return get_ptr(&disk->direct[idx], create, goal, meta);
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT) {
+    block = get_ptr(&disk->indirect, create, goal, true);
+    return block != 0 ? get_index_ptr(block, idx, create, goal, meta) : 0;
+  }
+  idx -= INDIRECT_CNT;
+
+  if (idx < DOUBLY_INDIRECT_CNT) {
+    block = get_ptr(&disk->doubly_indirect, create, goal, true);
+    if (block != 0)
+      block = get_index_ptr(block, idx / PTRS_PER_SECTOR, create, goal, true);
+    return block != 0 ? get_index_ptr(block, idx % PTRS_PER_SECTOR, create, goal, meta) : 0;
+  }
+  return 0;
+}
+
+/* Allocates a zeroed index block after GOAL, as allocate_zeroed()
+   does, and returns it, or 0 if the disk is full.  If RESERVED is
+   nonnull, the block comes out of *RESERVED sectors reserved with
+   free_map_reserve() instead, and *RESERVED is decremented. */
+static block_sector_t new_index_block(block_sector_t goal, size_t* reserved) {
+  block_sector_t sector;
+
+  if (reserved == NULL)
+    return allocate_zeroed(goal, &sector, true) ? sector : 0;
+
+  ASSERT(*reserved > 0);
+  if (!free_map_allocate_reserved(goal, 1, &sector))
+    PANIC("reserved sector not available");
+  (*reserved)--;
+  write_sector(true, sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  return sector;
+}
+
+/* Points DISK's entry for data sector IDX at SECTOR, which may
+   have UNWRITTEN set, allocating any index blocks needed to reach
+   it after SECTOR, out of RESERVED as new_index_block() does.
+   DISK is updated in memory only.  Returns false if the disk is
+   full, which cannot happen if RESERVED covers the index blocks
+   needed. */
+static bool set_index(struct inode_disk* disk, size_t idx, block_sector_t sector,
+                      size_t* reserved) {
+  block_sector_t goal = (sector & ~UNWRITTEN) + 1;
+  block_sector_t block;
+
+  if (idx < DIRECT_CNT) {
+    disk->direct[idx] = sector;
+    return true;
+  }
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT) {
+    if (disk->indirect == 0)
+      disk->indirect = new_index_block(goal, reserved);
+    block = disk->indirect;
+  } else {
+    size_t ofs;
+
+    idx -= INDIRECT_CNT;
+    if (disk->doubly_indirect == 0 &&
+        (disk->doubly_indirect = new_index_block(goal, reserved)) == 0)
+      return false;
+    ofs = idx / PTRS_PER_SECTOR * sizeof block;
+    cache_read(disk->doubly_indirect, &block, ofs, sizeof block);
+    if (block == 0 && (block = new_index_block(goal, reserved)) != 0)
+      log_write(disk->doubly_indirect, &block, ofs, sizeof block);
+    idx %= PTRS_PER_SECTOR;
+  }
+  if (block == 0)
+    return false;
+  log_write(block, &sector, idx * sizeof sector, sizeof sector);
+  return true;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
+   within INODE, or 0 if that part of INODE is a hole or has not
+   been written. */
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos) {
+  block_sector_t sector;
+
   ASSERT(inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  sector = index_to_sector(&inode->data, pos / BLOCK_SECTOR_SIZE, inode->sector, false);
+  return sector & UNWRITTEN ? 0 : sector;
+}
+
+/* Releases the sectors listed in index block BLOCK, descending
+   LEVELS more levels of index blocks, and BLOCK itself. */
+static void release_index(block_sector_t block, int levels) {
+  if (block == 0)
+    return;
+  if (levels > 0) {
+    size_t i;
+
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      release_index(get_index_ptr(block, i, false, 0, false), levels - 1);
+  }
+  free_map_release(block & ~UNWRITTEN, 1);
+}
+
+/* Releases every data and index sector of DISK. */
+static void deallocate(struct inode_disk* disk) {
+  size_t i;
+
+  if (disk->flags & INODE_INLINE)
+    return;
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_index(disk->direct[i], 0);
+  release_index(disk->indirect, 1);
+  release_index(disk->doubly_indirect, 2);
+}
+
+/* Returns the data of sector IDX of INODE if it is pending, or a
+   null pointer otherwise. */
+static uint8_t* pending_data(struct inode* inode, size_t idx) {
+  if (inode->pending_cnt > 0 && idx >= inode->pending_start &&
+      idx < inode->pending_start + inode->pending_cnt)
+    return inode->pending + (idx - inode->pending_start) * BLOCK_SECTOR_SIZE;
+  return NULL;
+}
+
+/* Frees INODE's page of pending sectors and takes INODE off
+   pending_inodes.  Its pending_cnt must already be 0. */
+static void drop_pending(struct inode* inode) {
+  ASSERT(inode->pending_cnt == 0);
+  palloc_free_page(inode->pending);
+  inode->pending = NULL;
+
+  lock_acquire(&pending_lock);
+  if (inode->pending_queued) {
+    list_remove(&inode->pending_elem);
+    inode->pending_queued = false;
+  }
+  lock_release(&pending_lock);
+}
+
+/* Places INODE's pending sectors on disk, within the current
+   journal operation, with INODE's data_lock held exclusively. */
+static void place_pending(struct inode* inode) {
+  struct inode_disk* disk = &inode->data;
+  size_t cnt = inode->pending_cnt;
+  size_t reserved = PENDING_INDEX;
+  block_sector_t start;
+  bool contiguous;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  contiguous = free_map_allocate_reserved(
+      allocation_goal(disk, inode->pending_start, inode->sector), cnt, &start);
+  for (i = 0; i < cnt; i++) {
+    size_t idx = inode->pending_start + i;
+    block_sector_t sector = start + i;
+
+    /* Reserved sectors are always available one at a time. */
+    if (!contiguous &&
+        !free_map_allocate_reserved(allocation_goal(disk, idx, inode->sector), 1, &sector))
+      PANIC("reserved sector not available");
+    cache_write_through(sector, inode->pending + i * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE);
+    if (!set_index(disk, idx, sector, &reserved))
+      PANIC("reserved sector not available");
+  }
+  log_write(inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+  free_map_unreserve(reserved);
+
+  inode->pending_cnt = 0;
+  drop_pending(inode);
+}
+
+/* Throws away INODE's pending sectors, giving back their
+   reservation, with INODE's data_lock held exclusively. */
+static void discard_pending(struct inode* inode) {
+  if (inode->pending_cnt == 0)
+    return;
+  free_map_unreserve(inode->pending_cnt + PENDING_INDEX);
+  inode->pending_cnt = 0;
+  drop_pending(inode);
+}
+
+/* Makes data sector IDX of INODE pending, if it is a hole past
+   end of file whose placement may be delayed.  Sectors already
+   pending that do not directly precede IDX are placed first.
+   Returns true if sector IDX is pending, false if it must be
+   allocated now.  Space for the index blocks that placing the
+   pending sectors may need is reserved along with the first of
+   them, so that placing them cannot fail. */
+static bool delay_sector(struct inode* inode, size_t idx) {
+  size_t reserve;
+
+  if (inode->data.flags & INODE_META)
+    return false;
+  if (pending_data(inode, idx) != NULL)
+    return true;
+  if (idx < bytes_to_sectors(inode->data.length))
+    return false;
+
+  if (inode->pending_cnt > 0 &&
+      (idx != inode->pending_start + inode->pending_cnt || inode->pending_cnt == PENDING_MAX))
+    place_pending(inode);
+  reserve = inode->pending_cnt == 0 ? 1 + PENDING_INDEX : 1;
+  if (!free_map_reserve(reserve))
+    return false;
+  if (inode->pending_cnt == 0) {
+    if (inode->pending == NULL)
+      inode->pending = palloc_get_page(0);
+    if (inode->pending == NULL) {
+      free_map_unreserve(reserve);
+      return false;
+    }
+    inode->pending_start = idx;
+
+    lock_acquire(&pending_lock);
+    if (!inode->pending_queued) {
+      list_push_back(&pending_inodes, &inode->pending_elem);
+      inode->pending_queued = true;
+    }
+    lock_release(&pending_lock);
+  }
+  memset(inode->pending + inode->pending_cnt * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE);
+  inode->pending_cnt++;
+  return true;
+}
+
+/* Places INODE's pending sectors on disk, or throws them away if
+   DISCARD is true. */
+static void flush_pending(struct inode* inode, bool discard) {
+  log_begin_op();
+  rw_lock_acquire(&inode->data_lock, false);
+  if (discard)
+    discard_pending(inode);
   else
-    return -1;
+    place_pending(inode);
+  rw_lock_release(&inode->data_lock, false);
+  log_end_op();
+}
+
+/* In-memory inodes, keyed by sector, so that opening a single
+   inode twice returns the same `struct inode'.
+
+   Besides the open inodes, the table retains up to CLOSED_MAX
+   inodes that were closed recently, so that a file opened and
+   closed over and over is read from disk only once.  An inode's
+   changes are written to the buffer cache as they are made, so
+   a closed inode is always clean and may be dropped at any
+   time.  Closed inodes are kept on closed_inodes, least recently
+   closed at the back, which is dropped first.  A removed inode
+   is never retained.
+
+   inode_table_lock protects the table, closed_inodes, and each
+   inode's open_cnt and removed members.  An inode's data_lock
+   protects its contents, so that different inodes may be read
+   and written at the same time.  It is a reader-writer lock:
+   reads, and writes that only overwrite allocated sectors, share
+   it, while writes that allocate sectors or change the inode
+   itself take it exclusively. */
+#define CLOSED_MAX 32
+
+static struct hash inode_table;
+static struct list closed_inodes;
+static size_t closed_cnt; /* Number of inodes in closed_inodes. */
+static struct lock inode_table_lock;
+
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
 
 /* Initializes the inode module. */
-void inode_init(void) { list_init(&open_inodes); }
+void inode_init(void) {
+  hash_init(&inode_table, inode_hash, inode_less, NULL);
+  list_init(&closed_inodes);
+  lock_init(&inode_table_lock);
+  list_init(&pending_inodes);
+  lock_init(&pending_lock);
+}
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data starts out as one unwritten hole, which
+   reads as zeros; sectors are allocated as it is written, so
+   creating a file takes the same time whatever its size.  The
+   data of a TYPE other than INODE_REGULAR is file system metadata
+   and is journaled.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
-bool inode_create(block_sector_t sector, off_t length) {
+   Returns false if memory allocation fails or LENGTH is too
+   large. */
+static bool disk_create(struct fs* fs UNUSED, block_sector_t sector, off_t length,
+                        enum inode_type type) {
   struct inode_disk* disk_inode = NULL;
   bool success = false;
 
@@ -69,103 +544,252 @@ bool inode_create(block_sector_t sector, off_t length) {
 
   disk_inode = calloc(1, sizeof *disk_inode);
   if (disk_inode != NULL) {
-    size_t sectors = bytes_to_sectors(length);
     disk_inode->length = length;
     disk_inode->magic = INODE_MAGIC;
-    if (free_map_allocate(sectors, &disk_inode->start)) {
-      block_write(fs_device, sector, disk_inode);
-      if (sectors > 0) {
-        static char zeros[BLOCK_SECTOR_SIZE];
-        size_t i;
-
-        for (i = 0; i < sectors; i++)
-          block_write(fs_device, disk_inode->start + i, zeros);
-      }
-      success = true;
-    }
+    if (length <= (off_t)INLINE_MAX)
+      disk_inode->flags |= INODE_INLINE;
+    if (type != INODE_REGULAR)
+      disk_inode->flags |= INODE_META;
+    if (type == INODE_DIRECTORY)
+      disk_inode->flags |= INODE_DIR;
+    success = bytes_to_sectors(length) <= MAX_SECTORS;
+    if (success)
+      log_write(sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
     free(disk_inode);
   }
   return success;
 }
 
-/* Reads an inode from SECTOR
+/* Reads INODE from its sector. */
+static bool disk_open(struct inode* inode) {
+  cache_read(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Frees removed INODE's sector and data sectors. */
+static void disk_release(struct inode* inode) {
+  free_map_release(inode->sector, 1);
+  deallocate(&inode->data);
+}
+
+/* Creates inode INUMBER, with LENGTH bytes of data, of the given
+   TYPE, on the file system that INUMBER belongs to.  On disk_fs
+   this is described above.  Returns true if successful. */
+bool inode_create(block_sector_t inumber, off_t length, enum inode_type type) {
+  struct fs* fs = vfs_find(inumber);
+
+  return fs != NULL && fs->ops->create(fs, inumber, length, type);
+}
+
+/* Allocates an inode number for a new file in directory DIR, on
+   DIR's file system, and stores it into *INUMBERP.  Returns
+   false if the file system is full. */
+bool inode_alloc_inumber(const struct inode* dir, block_sector_t* inumberp) {
+  return dir->fs->ops->alloc_inumber(dir->fs, dir->sector, inumberp);
+}
+
+/* Frees INUMBER, allocated by inode_alloc_inumber() but never
+   created. */
+void inode_free_inumber(block_sector_t inumber) {
+  struct fs* fs = vfs_find(inumber);
+
+  ASSERT(fs != NULL);
+  fs->ops->free_inumber(fs, inumber);
+}
+
+/* Reads inode INUMBER, from whichever file system it is on,
    and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
+   Returns a null pointer if memory allocation fails or there is
+   no such inode. */
 struct inode* inode_open(block_sector_t sector) {
-  struct list_elem* e;
+  struct inode key;
+  struct hash_elem* e;
   struct inode* inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      return inode;
+  /* Check whether this inode is already in memory. */
+  key.sector = sector;
+  lock_acquire(&inode_table_lock);
+  e = hash_find(&inode_table, &key.elem);
+  if (e != NULL) {
+    inode = hash_entry(e, struct inode, elem);
+    if (inode->open_cnt == 0) {
+      list_remove(&inode->lru_elem);
+      closed_cnt--;
     }
+    inode->open_cnt++;
+    lock_release(&inode_table_lock);
+    return inode;
   }
+  lock_release(&inode_table_lock);
 
   /* Allocate memory. */
   inode = malloc(sizeof *inode);
   if (inode == NULL)
     return NULL;
+  inode->fs = vfs_find(sector);
+  inode->aux = NULL;
 
-  /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
+  /* Initialize, reading the inode without holding the table lock. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read(fs_device, inode->sector, &inode->data);
+  inode->pending = NULL;
+  inode->pending_cnt = 0;
+  inode->pending_queued = false;
+  lock_init(&inode->lock);
+  rw_lock_init(&inode->data_lock);
+  if (inode->fs == NULL || !inode->fs->ops->open(inode)) {
+    free(inode);
+    return NULL;
+  }
+
+  /* Someone else may have opened it meanwhile. */
+  lock_acquire(&inode_table_lock);
+  e = hash_insert(&inode_table, &inode->elem);
+  if (e != NULL) {
+    free(inode);
+    inode = hash_entry(e, struct inode, elem);
+    if (inode->open_cnt == 0) {
+      list_remove(&inode->lru_elem);
+      closed_cnt--;
+    }
+    inode->open_cnt++;
+  }
+  lock_release(&inode_table_lock);
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  if (inode != NULL)
+  if (inode != NULL) {
+    lock_acquire(&inode_table_lock);
     inode->open_cnt++;
+    lock_release(&inode_table_lock);
+  }
   return inode;
 }
 
 /* Returns INODE's inode number. */
 block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sector; }
 
+static bool disk_is_dir(const struct inode* inode) { return (inode->data.flags & INODE_DIR) != 0; }
+
+/* Returns true if INODE is a directory. */
+bool inode_is_dir(const struct inode* inode) { return inode->fs->ops->is_dir(inode); }
+
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, it is retained among
+   the recently closed inodes, unless it was also a removed
+   inode, in which case its memory and blocks are freed. */
 void inode_close(struct inode* inode) {
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  /* The last opener places or discards pending sectors first.
+     Nobody else can add more, but inode_flush() may reopen the
+     inode meanwhile.  pending_cnt is read under data_lock, which
+     comes before inode_table_lock in the lock order. */
+  for (;;) {
+    bool pending, removed;
+
+    rw_lock_acquire(&inode->data_lock, true);
+    lock_acquire(&inode_table_lock);
+    pending = inode->pending_cnt > 0;
+    rw_lock_release(&inode->data_lock, true);
+    if (inode->open_cnt > 1 || !pending)
+      break;
+    removed = inode->removed;
+    lock_release(&inode_table_lock);
+    flush_pending(inode, removed);
+  }
+
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
-
-    /* Deallocate blocks if removed. */
     if (inode->removed) {
-      free_map_release(inode->sector, 1);
-      free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
+      hash_delete(&inode_table, &inode->elem);
+      lock_release(&inode_table_lock);
+      inode->fs->ops->release(inode);
+      free(inode);
+      return;
     }
 
-    free(inode);
+    /* Retain it, dropping the least recently closed inode if
+       there are too many. */
+    list_push_front(&closed_inodes, &inode->lru_elem);
+    if (++closed_cnt > CLOSED_MAX) {
+      struct inode* victim = list_entry(list_pop_back(&closed_inodes), struct inode, lru_elem);
+      hash_delete(&inode_table, &victim->elem);
+      free(victim);
+      closed_cnt--;
+    }
   }
+  lock_release(&inode_table_lock);
+}
+
+/* Returns true if INODE has been removed. */
+bool inode_is_removed(struct inode* inode) {
+  bool removed;
+
+  lock_acquire(&inode_table_lock);
+  removed = inode->removed;
+  lock_release(&inode_table_lock);
+  return removed;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void inode_remove(struct inode* inode) {
   ASSERT(inode != NULL);
+  lock_acquire(&inode_table_lock);
   inode->removed = true;
+  lock_release(&inode_table_lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
+/* Places the pending sectors of every inode on disk, so that
+   they survive a crash. */
+void inode_flush(void) {
+  for (;;) {
+    struct inode* inode;
+
+    lock_acquire(&pending_lock);
+    if (list_empty(&pending_inodes)) {
+      lock_release(&pending_lock);
+      return;
+    }
+    inode = list_entry(list_pop_front(&pending_inodes), struct inode, pending_elem);
+    inode->pending_queued = false;
+    inode_reopen(inode);
+    lock_release(&pending_lock);
+
+    flush_pending(inode, false);
+    inode_close(inode);
+  }
+}
+
+/* Acquires INODE's lock.  The lock is not used by the inode
+   module itself; its user may take it to make a series of reads
+   and writes atomic, as the directory code does. */
+void inode_lock(struct inode* inode) { lock_acquire(&inode->lock); }
+
+/* Releases INODE's lock. */
+void inode_unlock(struct inode* inode) { lock_release(&inode->lock); }
+
+/* Reads as inode_read_at() does, with INODE's data_lock held. */
+static off_t read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
   uint8_t* buffer = buffer_;
+  uint8_t* pending;
   off_t bytes_read = 0;
-  uint8_t* bounce = NULL;
+
+  if (inode->data.flags & INODE_INLINE) {
+    if (offset >= inode->data.length || size <= 0)
+      return 0;
+    if (size > inode->data.length - offset)
+      size = inode->data.length - offset;
+    memcpy(buffer, inode->data.inline_data + offset, size);
+    return size;
+  }
 
   while (size > 0) {
     /* Disk sector to read, starting byte offset within sector. */
@@ -173,7 +797,7 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
     /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
+    off_t inode_left = inode->data.length - offset;
     int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
     int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -182,106 +806,713 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
     if (chunk_size <= 0)
       break;
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Read full sector directly into caller's buffer. */
-      block_read(fs_device, sector_idx, buffer + bytes_read);
-    } else {
-      /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
-      }
-      block_read(fs_device, sector_idx, bounce);
-      memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
+    /* Start fetching the next sector before it is wanted. */
+    if (inode_left > sector_left) {
+      block_sector_t next = byte_to_sector(inode, offset + sector_left);
+      if (next != 0)
+        cache_read_ahead(next);
     }
+    if (sector_idx != 0)
+      cache_read(sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+    else if ((pending = pending_data(inode, offset / BLOCK_SECTOR_SIZE)) != NULL)
+      memcpy(buffer + bytes_read, pending + sector_ofs, chunk_size);
+    else
+      memset(buffer + bytes_read, 0, chunk_size);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_read += chunk_size;
   }
-  free(bounce);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
-  const uint8_t* buffer = buffer_;
+static off_t disk_read_at(struct inode* inode, void* buffer, off_t size, off_t offset) {
+  off_t bytes_read;
+
+  rw_lock_acquire(&inode->data_lock, true);
+  bytes_read = read_at(inode, buffer, size, offset);
+  rw_lock_release(&inode->data_lock, true);
+  return bytes_read;
+}
+
+/* Asks for the sectors of INODE holding bytes START through
+   END - 1 to be read into the cache in the background, as
+   cache_read_ahead() does.  Holes and bytes past end of file are
+   skipped. */
+static void disk_read_ahead(struct inode* inode, off_t start, off_t end) {
+  off_t pos;
+
+  rw_lock_acquire(&inode->data_lock, true);
+  if (!(inode->data.flags & INODE_INLINE)) {
+    if (end > inode->data.length)
+      end = inode->data.length;
+    for (pos = start - start % BLOCK_SECTOR_SIZE; pos < end; pos += BLOCK_SECTOR_SIZE) {
+      block_sector_t sector = byte_to_sector(inode, pos);
+      if (sector != 0)
+        cache_read_ahead(sector);
+    }
+  }
+  rw_lock_release(&inode->data_lock, true);
+}
+
+/* Moves the data of inline INODE into a newly allocated data
+   sector, so that it can grow past INLINE_MAX bytes.  The inode
+   itself is written by the caller.  Returns false if the disk is
+   full. */
+static bool promote_inline(struct inode* inode) {
+  struct inode_disk* disk = &inode->data;
+  bool meta = (disk->flags & INODE_META) != 0;
+  block_sector_t sector = 0;
+
+  if (disk->length > 0) {
+    if (!allocate_zeroed(inode->sector + 1, &sector, meta))
+      return false;
+    write_new_sector(meta, sector, disk->inline_data, 0, disk->length);
+  }
+  memset(disk->inline_data, 0, INLINE_MAX);
+  disk->direct[0] = sector;
+  disk->flags &= ~INODE_INLINE;
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as inode_write_at() does, within the current journal
+   operation. */
+static off_t write_chunk(struct inode* inode, const uint8_t* buffer, off_t size, off_t offset) {
+  bool meta = (inode->data.flags & INODE_META) != 0;
   off_t bytes_written = 0;
-  uint8_t* bounce = NULL;
+  bool index_changed = false;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  if (inode->data.flags & INODE_INLINE) {
+    if (size > 0 && offset + size <= (off_t)INLINE_MAX) {
+      memcpy(inode->data.inline_data + offset, buffer, size);
+      if (offset + size > inode->data.length)
+        inode->data.length = offset + size;
+      log_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      return size;
+    }
+    if (size > 0) {
+      if (!promote_inline(inode))
+        return 0;
+      index_changed = true;
+    }
+  }
 
   while (size > 0) {
-    /* Sector to write, starting byte offset within sector. */
+    /* Sector to write, starting byte offset within sector.
+       Allocate the sector first if it is a hole. */
+    size_t idx = offset / BLOCK_SECTOR_SIZE;
     block_sector_t sector_idx = byte_to_sector(inode, offset);
     int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
+    /* Bytes to write into this sector. */
     int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
-
-    /* Number of bytes to actually write into this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
-      break;
+    int chunk_size = size < sector_left ? size : sector_left;
+    bool marks_written = false;
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Write full sector directly to disk. */
-      block_write(fs_device, sector_idx, buffer + bytes_written);
-    } else {
-      /* We need a bounce buffer. */
-      if (bounce == NULL) {
-        bounce = malloc(BLOCK_SECTOR_SIZE);
-        if (bounce == NULL)
-          break;
+    if (sector_idx == 0 && delay_sector(inode, idx)) {
+      memcpy(pending_data(inode, idx) + sector_ofs, buffer + bytes_written, chunk_size);
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+      continue;
+    }
+    if (sector_idx == 0) {
+      sector_idx = index_to_sector(&inode->data, idx, inode->sector, true);
+      if (sector_idx == 0)
+        break;
+      if (sector_idx & UNWRITTEN) {
+        /* Preallocated: zero what this write leaves out, then
+           mark it written.  The zeros and the data reach the
+           disk together, below, before the index does. */
+        sector_idx &= ~UNWRITTEN;
+        if (chunk_size < BLOCK_SECTOR_SIZE)
+          write_sector(meta, sector_idx, zeros, 0, BLOCK_SECTOR_SIZE);
+        set_index(&inode->data, idx, sector_idx, NULL);
+        marks_written = true;
       }
-
-      /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-      if (sector_ofs > 0 || chunk_size < sector_left)
-        block_read(fs_device, sector_idx, bounce);
-      else
-        memset(bounce, 0, BLOCK_SECTOR_SIZE);
-      memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-      block_write(fs_device, sector_idx, bounce);
+      index_changed = true;
     }
+    if (marks_written)
+      write_new_sector(meta, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+    else
+      write_sector(meta, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
   }
-  free(bounce);
 
+  if (offset > inode->data.length) {
+    inode->data.length = offset;
+    index_changed = true;
+  }
+  if (index_changed)
+    log_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  return bytes_written;
+}
+
+/* Returns true if writing SIZE bytes to INODE at OFFSET would
+   only overwrite data sectors that are already allocated, leaving
+   the inode and its index unchanged, so that the write may share
+   INODE's data_lock.  Journaled and inline data always change the
+   inode or the journal's view of it, so they never qualify.
+   INODE's data_lock must be held. */
+static bool overwrites_in_place(struct inode* inode, off_t size, off_t offset) {
+  off_t pos;
+
+  if (inode->data.flags & (INODE_INLINE | INODE_META) || offset + size > inode->data.length)
+    return false;
+  for (pos = offset - offset % BLOCK_SECTOR_SIZE; pos < offset + size; pos += BLOCK_SECTOR_SIZE)
+    if (byte_to_sector(inode, pos) == 0)
+      return false;
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, as inode_write_at()
+   does.  Sectors are only allocated for the bytes actually
+   written, so any gap between the old end of file and OFFSET is
+   left as a hole.
+   Large writes are journaled as several operations, so a crash
+   may leave part of one done.  Overwrites of allocated data run
+   in parallel with reads and with each other; other writes are
+   exclusive. */
+static off_t disk_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
+  const uint8_t* buffer = buffer_;
+  off_t bytes_written = 0;
+
+  while (size > 0) {
+    off_t max = WRITE_CHUNK(&inode->data);
+    off_t chunk = size < max ? size : max;
+    off_t written = 0;
+    bool shared = true;
+
+    /* Begin the operation before locking, since beginning it may
+       wait for other operations, which may need the lock, to
+       commit. */
+    log_begin_op();
+    rw_lock_acquire(&inode->data_lock, true);
+    if (!overwrites_in_place(inode, chunk, offset)) {
+      rw_lock_release(&inode->data_lock, true);
+      rw_lock_acquire(&inode->data_lock, false);
+      shared = false;
+    }
+    if (!inode->deny_write_cnt)
+      written = write_chunk(inode, buffer + bytes_written, chunk, offset);
+    rw_lock_release(&inode->data_lock, shared);
+    log_end_op();
+
+    size -= written;
+    offset += written;
+    bytes_written += written;
+    if (written < chunk)
+      break;
+  }
   return bytes_written;
 }
 
+/* Allocates sectors of INODE from data sector IDX up to END as
+   inode_allocate() does, within the current journal operation,
+   with INODE's data_lock held exclusively, and extends INODE to
+   at least LENGTH bytes.  *NEXT is the sector that would continue
+   the run of sectors so far, or 0 at the start; *CONTIGUOUS is
+   set to false if a sector does not.  Returns false if the disk
+   fills up. */
+static bool allocate_range(struct inode* inode, size_t idx, size_t end, off_t length,
+                           block_sector_t* next, bool* contiguous) {
+  struct inode_disk* disk = &inode->data;
+  bool success = true;
+
+  if ((disk->flags & INODE_INLINE) && length > (off_t)INLINE_MAX && !promote_inline(inode))
+    return false;
+  if (!(disk->flags & INODE_INLINE)) {
+    place_pending(inode);
+    while (idx < end) {
+      block_sector_t sector = lookup_index(disk, idx, false, 0) & ~UNWRITTEN;
+      size_t cnt = 1;
+
+      if (sector == 0) {
+        /* Allocate as much of the run of holes here as fits in
+           one extent. */
+        size_t i;
+
+        while (idx + cnt < end && lookup_index(disk, idx + cnt, false, 0) == 0)
+          cnt++;
+        while (!free_map_allocate_near(allocation_goal(disk, idx, inode->sector), cnt, &sector))
+          if ((cnt /= 2) == 0)
+            break;
+        if (cnt == 0) {
+          success = false;
+          break;
+        }
+        for (i = 0; i < cnt; i++)
+          if (!set_index(disk, idx + i, (sector + i) | UNWRITTEN, NULL)) {
+            free_map_release(sector + i, cnt - i);
+            cnt = i;
+            success = false;
+            break;
+          }
+      }
+      if (*next != 0 && sector != *next)
+        *contiguous = false;
+      *next = sector + cnt;
+      idx += cnt;
+      if (!success)
+        break;
+    }
+  }
+  if (success && length > disk->length)
+    disk->length = length;
+  log_write(inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+  return success;
+}
+
+/* Allocates disk space for INODE as inode_allocate() does.
+   Newly allocated sectors are not written; they are marked
+   unwritten and read as zeros until they are.  Holes are filled with as few extents as possible.
+   Sets *CONTIGUOUS to true if the range's sectors, old and new,
+   are consecutive on disk, false otherwise.  Returns false if the
+   disk fills up, leaving some of the range allocated, or if
+   writes to INODE are denied. */
+static bool disk_allocate(struct inode* inode, off_t offset, off_t size, bool* contiguous) {
+  size_t chunk = WRITE_CHUNK(&inode->data) / BLOCK_SECTOR_SIZE;
+  block_sector_t next = 0;
+  bool success = true;
+  size_t idx, end;
+
+  *contiguous = true;
+  if (offset < 0)
+    return false;
+  if (size <= 0)
+    return size == 0;
+  if (offset + size < offset || bytes_to_sectors(offset + size) > MAX_SECTORS)
+    return false;
+
+  idx = offset / BLOCK_SECTOR_SIZE;
+  end = bytes_to_sectors(offset + size);
+  while (success && idx < end) {
+    size_t chunk_end = end - idx < chunk ? end : idx + chunk;
+    off_t length = offset + size;
+
+    if ((off_t)(chunk_end * BLOCK_SECTOR_SIZE) < length)
+      length = chunk_end * BLOCK_SECTOR_SIZE;
+
+    /* Each chunk is one journal operation, as in
+       inode_write_at(). */
+    log_begin_op();
+    rw_lock_acquire(&inode->data_lock, false);
+    if (inode->deny_write_cnt)
+      success = false;
+    else
+      success = allocate_range(inode, idx, chunk_end, length, &next, contiguous);
+    rw_lock_release(&inode->data_lock, false);
+    log_end_op();
+
+    idx = chunk_end;
+  }
+  return success;
+}
+
+/* Returns true if the byte at POS in INODE reads as zero without
+   being stored: it lies past end of file, in a hole, or in an
+   unwritten sector.  INODE's data_lock must be held. */
+static bool is_hole(struct inode* inode, off_t pos) {
+  if (pos >= inode->data.length)
+    return true;
+  if (inode->data.flags & INODE_INLINE)
+    return false;
+  return byte_to_sector(inode, pos) == 0 && pending_data(inode, pos / BLOCK_SECTOR_SIZE) == NULL;
+}
+
+/* Returns how many of the SIZE bytes of INODE starting at OFFSET
+   lie in a run of holes at the start of that range.  INODE's
+   data_lock must be held. */
+static off_t hole_bytes(struct inode* inode, off_t offset, off_t size) {
+  off_t pos = offset;
+
+  while (pos < offset + size && is_hole(inode, pos))
+    pos = pos - pos % BLOCK_SECTOR_SIZE + BLOCK_SECTOR_SIZE;
+  return (pos < offset + size ? pos : offset + size) - offset;
+}
+
+/* Extends INODE to LENGTH bytes, if it is shorter, without
+   allocating data sectors, so that the new bytes are a hole.
+   Returns false if the disk is full or writes to INODE are
+   denied. */
+static bool extend(struct inode* inode, off_t length) {
+  bool success = true;
+
+  if (bytes_to_sectors(length) > MAX_SECTORS)
+    return false;
+
+  log_begin_op();
+  rw_lock_acquire(&inode->data_lock, false);
+  if (inode->deny_write_cnt)
+    success = false;
+  else if (length > inode->data.length) {
+    if ((inode->data.flags & INODE_INLINE) && length > (off_t)INLINE_MAX)
+      success = promote_inline(inode);
+    if (success) {
+      inode->data.length = length;
+      log_write(inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+    }
+  }
+  rw_lock_release(&inode->data_lock, false);
+  log_end_op();
+  return success;
+}
+
+/* Copies data between two inodes on disk_fs, as
+   inode_copy_range() does.  The data moves a page at a time
+   through a kernel buffer, read with IN's data_lock shared and
+   written as by inode_write_at(), so whole sectors go from cache
+   to cache.  A run of holes in IN is not
+   copied at all if it would land on holes in OUT, so that sparse
+   files stay sparse.  The two locks are never held together.
+   Copying stops at IN's end of file.  Returns the number of bytes
+   copied, which may be less than SIZE if the disk fills up or
+   writes to OUT are denied.  If IN and OUT are the same inode,
+   the ranges must not overlap. */
+static off_t disk_copy_range(struct inode* in, off_t in_ofs, struct inode* out, off_t out_ofs,
+                             off_t size) {
+  uint8_t* buffer = palloc_get_page(0);
+  off_t copied = 0, written_end = out_ofs;
+
+  if (buffer == NULL)
+    return 0;
+
+  while (size > 0) {
+    off_t chunk = size < PGSIZE ? size : PGSIZE;
+    off_t skip = 0, done;
+    bool holes = false;
+
+    rw_lock_acquire(&in->data_lock, true);
+    if (chunk > in->data.length - in_ofs)
+      chunk = in->data.length - in_ofs;
+    if (chunk > 0) {
+      skip = hole_bytes(in, in_ofs, chunk);
+      if (skip == 0)
+        chunk = read_at(in, buffer, chunk, in_ofs);
+    }
+    rw_lock_release(&in->data_lock, true);
+    if (chunk <= 0)
+      break;
+
+    if (skip > 0) {
+      /* IN reads as zeros here.  Nothing need be written unless
+         OUT has data to overwrite. */
+      chunk = skip;
+      rw_lock_acquire(&out->data_lock, true);
+      holes = hole_bytes(out, out_ofs, chunk) == chunk;
+      rw_lock_release(&out->data_lock, true);
+      if (!holes)
+        memset(buffer, 0, chunk);
+    }
+    done = holes ? chunk : disk_write_at(out, buffer, chunk, out_ofs);
+
+    size -= done;
+    in_ofs += done;
+    out_ofs += done;
+    copied += done;
+    if (!holes)
+      written_end = out_ofs;
+    if (done < chunk)
+      break;
+  }
+  palloc_free_page(buffer);
+
+  /* Holes skipped at the end must still extend OUT. */
+  if (out_ofs > written_end && !extend(out, out_ofs))
+    copied -= out_ofs - written_end;
+  return copied;
+}
+
+/* Returns the number of fragments of INODE's data: runs of data
+   sectors that follow one another on disk.  Holes and pending
+   sectors do not count.  An inline inode has no fragments. */
+static int disk_fragments(struct inode* inode) {
+  struct inode_disk* disk = &inode->data;
+  block_sector_t next = 0;
+  int fragment_cnt = 0;
+
+  rw_lock_acquire(&inode->data_lock, true);
+  if (!(disk->flags & INODE_INLINE)) {
+    size_t idx, end = bytes_to_sectors(disk->length);
+
+    for (idx = 0; idx < end; idx++) {
+      block_sector_t sector = lookup_index(disk, idx, false, 0) & ~UNWRITTEN;
+      if (sector == 0)
+        continue;
+      if (sector != next)
+        fragment_cnt++;
+      next = sector + 1;
+    }
+  }
+  rw_lock_release(&inode->data_lock, true);
+  return fragment_cnt;
+}
+
+/* Returns the number of allocated data sectors of INODE.
+   INODE's data_lock must be held. */
+static size_t data_sectors(struct inode* inode) {
+  struct inode_disk* disk = &inode->data;
+  size_t idx, end = bytes_to_sectors(disk->length);
+  size_t cnt = 0;
+
+  if (disk->flags & INODE_INLINE)
+    return 0;
+  for (idx = 0; idx < end; idx++)
+    if (lookup_index(disk, idx, false, 0) != 0)
+      cnt++;
+  return cnt;
+}
+
+/* Moves data sectors IDX up to END of INODE to consecutive
+   sectors starting at *NEXT, or as near after it as are free,
+   advancing *NEXT past them.  BUFFER is a sector of scratch
+   space.  Runs within the current journal operation with
+   INODE's data_lock held exclusively.  Returns false if the disk
+   fills up.
+   Each copy is on disk before the journaled index points to it,
+   and the old sectors, freed in the same transaction, are not
+   reused until it commits, so a crash leaves the file with
+   either its old or its new sectors. */
+static bool move_range(struct inode* inode, size_t idx, size_t end, block_sector_t* next,
+                       uint8_t* buffer) {
+  struct inode_disk* disk = &inode->data;
+  bool success = true;
+
+  for (; idx < end; idx++) {
+    block_sector_t old = lookup_index(disk, idx, false, 0);
+    block_sector_t sector;
+
+    if (old == 0)
+      continue;
+    if ((old & ~UNWRITTEN) == *next) {
+      (*next)++;
+      continue;
+    }
+    if (!free_map_allocate_near(*next, 1, &sector)) {
+      success = false;
+      break;
+    }
+
+    /* An unwritten sector has no data to copy. */
+    if (!(old & UNWRITTEN)) {
+      cache_read(old, buffer, 0, BLOCK_SECTOR_SIZE);
+      cache_write_through(sector, buffer, 0, BLOCK_SECTOR_SIZE);
+    }
+    if (!set_index(disk, idx, sector | (old & UNWRITTEN), NULL)) {
+      free_map_release(sector, 1);
+      success = false;
+      break;
+    }
+    free_map_release(old & ~UNWRITTEN, 1);
+    *next = sector + 1;
+  }
+  log_write(inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+  return success;
+}
+
+/* Moves INODE's data sectors into one run of consecutive free
+   sectors, near the inode, if they are in more than one
+   fragment.  Only a regular file's data moves; a metadata
+   inode's is journaled in place.  The data moves a chunk at a
+   time, each chunk one journal operation with INODE's data_lock
+   held exclusively, so that INODE stays readable and writable
+   in between.  Returns false if no free run is long enough, or
+   if the disk fills up or memory runs out partway, in which case
+   INODE is left intact but only partly moved. */
+static bool disk_defragment(struct inode* inode) {
+  size_t chunk = WRITE_CHUNK(&inode->data) / BLOCK_SECTOR_SIZE;
+  block_sector_t next;
+  uint8_t* buffer;
+  size_t idx, cnt;
+  bool success = true;
+
+  if (disk_fragments(inode) <= 1)
+    return true;
+
+  rw_lock_acquire(&inode->data_lock, true);
+  cnt = data_sectors(inode);
+  rw_lock_release(&inode->data_lock, true);
+  if ((inode->data.flags & INODE_META) || !free_map_find(inode->sector + 1, cnt, &next))
+    return false;
+  buffer = malloc(BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+
+  for (idx = 0; success; idx += chunk) {
+    bool done;
+
+    log_begin_op();
+    rw_lock_acquire(&inode->data_lock, false);
+    done = idx >= bytes_to_sectors(inode->data.length);
+    if (!done)
+      success = move_range(inode, idx, idx + chunk, &next, buffer);
+    rw_lock_release(&inode->data_lock, false);
+    log_end_op();
+    if (done)
+      break;
+  }
+  free(buffer);
+  return success;
+}
+
+static off_t disk_length(const struct inode* inode) { return inode->data.length; }
+
+/* Allocates a sector for an inode near NEAR. */
+static bool disk_alloc_inumber(struct fs* fs UNUSED, block_sector_t near,
+                               block_sector_t* inumberp) {
+  return free_map_allocate_near(near, 1, inumberp);
+}
+
+static void disk_free_inumber(struct fs* fs UNUSED, block_sector_t inumber) {
+  free_map_release(inumber, 1);
+}
+
+static const struct fs_ops disk_ops = {
+    .alloc_inumber = disk_alloc_inumber,
+    .free_inumber = disk_free_inumber,
+    .create = disk_create,
+    .open = disk_open,
+    .release = disk_release,
+    .read_at = disk_read_at,
+    .write_at = disk_write_at,
+    .allocate = disk_allocate,
+    .length = disk_length,
+    .is_dir = disk_is_dir,
+    .read_ahead = disk_read_ahead,
+    .copy_range = disk_copy_range,
+    .fragments = disk_fragments,
+    .defragment = disk_defragment,
+};
+
+/* The file system on fs_device.  vfs_init() fills in the rest. */
+struct fs disk_fs = {.ops = &disk_ops};
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t inode_read_at(struct inode* inode, void* buffer, off_t size, off_t offset) {
+  return inode->fs->ops->read_at(inode, buffer, size, offset);
+}
+
+/* Asks for the bytes of INODE from START through END - 1 to be
+   read ahead, if its file system reads from a device. */
+void inode_read_ahead(struct inode* inode, off_t start, off_t end) {
+  if (inode->fs->ops->read_ahead != NULL)
+    inode->fs->ops->read_ahead(inode, start, end);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the file system fills up or an error occurs,
+   or 0 if writes to INODE are denied.  Writing past end of file
+   extends the inode. */
+off_t inode_write_at(struct inode* inode, const void* buffer, off_t size, off_t offset) {
+  return inode->fs->ops->write_at(inode, buffer, size, offset);
+}
+
+/* Allocates space for the SIZE bytes of INODE starting at
+   OFFSET, extending INODE if they lie past its end, so that later
+   writes there need not allocate.  Sets *CONTIGUOUS to true if
+   the range is stored contiguously, false otherwise.  Returns
+   false if the file system fills up or writes to INODE are
+   denied. */
+bool inode_allocate(struct inode* inode, off_t offset, off_t size, bool* contiguous) {
+  return inode->fs->ops->allocate(inode, offset, size, contiguous);
+}
+
+/* Copies SIZE bytes of IN starting at IN_OFS to OUT starting at
+   OUT_OFS, without passing them through user memory.  Within a
+   file system that can copy by itself, as disk_fs can, it does
+   so; otherwise the data is read and written a page at a time.
+   Copying stops at IN's end of file.  Returns the number of bytes
+   copied, which may be less than SIZE if OUT's file system fills
+   up or writes to OUT are denied.  If IN and OUT are the same
+   inode, the ranges must not overlap. */
+off_t inode_copy_range(struct inode* in, off_t in_ofs, struct inode* out, off_t out_ofs, off_t size) {
+  uint8_t* buffer;
+  off_t copied = 0;
+
+  if (in->fs == out->fs && in->fs->ops->copy_range != NULL)
+    return in->fs->ops->copy_range(in, in_ofs, out, out_ofs, size);
+
+  buffer = palloc_get_page(0);
+  if (buffer == NULL)
+    return 0;
+  while (size > 0) {
+    off_t chunk = inode_read_at(in, buffer, size < PGSIZE ? size : PGSIZE, in_ofs + copied);
+    off_t done = chunk > 0 ? inode_write_at(out, buffer, chunk, out_ofs + copied) : 0;
+
+    size -= done;
+    copied += done;
+    if (chunk <= 0 || done < chunk)
+      break;
+  }
+  palloc_free_page(buffer);
+  return copied;
+}
+
+/* Returns the number of fragments of INODE's data on its device,
+   or 0 if its file system has no device. */
+int inode_fragments(struct inode* inode) {
+  return inode->fs->ops->fragments != NULL ? inode->fs->ops->fragments(inode) : 0;
+}
+
+/* Moves INODE's data into one fragment on its device, if its
+   file system has one.  Returns false on failure. */
+bool inode_defragment(struct inode* inode) {
+  return inode->fs->ops->defragment == NULL || inode->fs->ops->defragment(inode);
+}
+
+/* Returns the state that INODE's file system keeps for it. */
+void* inode_get_aux(const struct inode* inode) { return inode->aux; }
+
+/* Sets the state that INODE's file system keeps for it to AUX.
+   For use by its open operation. */
+void inode_set_aux(struct inode* inode, void* aux) { inode->aux = aux; }
+
+/* Begins a write to INODE by a file system other than disk_fs,
+   holding off inode_deny_write() until inode_write_end().
+   Returns false, with nothing to end, if writes to INODE are
+   denied. */
+bool inode_write_begin(struct inode* inode) {
+  rw_lock_acquire(&inode->data_lock, true);
+  if (inode->deny_write_cnt) {
+    rw_lock_release(&inode->data_lock, true);
+    return false;
+  }
+  return true;
+}
+
+/* Ends a write to INODE begun by inode_write_begin(). */
+void inode_write_end(struct inode* inode) { rw_lock_release(&inode->data_lock, true); }
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void inode_deny_write(struct inode* inode) {
+  rw_lock_acquire(&inode->data_lock, false);
   inode->deny_write_cnt++;
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
+  rw_lock_release(&inode->data_lock, false);
 }
 
 /* Re-enables writes to INODE.
    Must be called once by each inode opener who has called
    inode_deny_write() on the inode, before closing the inode. */
 void inode_allow_write(struct inode* inode) {
+  rw_lock_acquire(&inode->data_lock, false);
   ASSERT(inode->deny_write_cnt > 0);
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rw_lock_release(&inode->data_lock, false);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
-off_t inode_length(const struct inode* inode) { return inode->data.length; }
+off_t inode_length(const struct inode* inode) { return inode->fs->ops->length(inode); }
@@ -6,16 +6,36 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct inode;
+
+/* Kinds of inode. */
+enum inode_type {
+  INODE_REGULAR,  /* Ordinary file. */
+  INODE_SYSTEM,   /* File system metadata file, journaled. */
+  INODE_DIRECTORY /* Directory, journaled. */
+};
 
 void inode_init(void);
-bool inode_create(block_sector_t, off_t);
+bool inode_create(block_sector_t, off_t, enum inode_type);
+bool inode_alloc_inumber(const struct inode* dir, block_sector_t*);
+void inode_free_inumber(block_sector_t);
 struct inode* inode_open(block_sector_t);
 struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
+bool inode_is_dir(const struct inode*);
+bool inode_is_removed(struct inode*);
 void inode_close(struct inode*);
 void inode_remove(struct inode*);
+void inode_flush(void);
+void inode_lock(struct inode*);
+void inode_unlock(struct inode*);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
+void inode_read_ahead(struct inode*, off_t start, off_t end);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+bool inode_allocate(struct inode*, off_t offset, off_t size, bool* contiguous);
+off_t inode_copy_range(struct inode* in, off_t in_ofs, struct inode* out, off_t out_ofs, off_t size);
+int inode_fragments(struct inode*);
+bool inode_defragment(struct inode*);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
 off_t inode_length(const struct inode*);
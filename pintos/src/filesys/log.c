@@ -0,0 +1,306 @@
+#include "filesys/log.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal of file system metadata.
+
+   Metadata sectors (inodes, index blocks, directories, and the
+   free map) are modified only within operations bracketed by
+   log_begin_op() and log_end_op(), and are written with
+   log_write() instead of cache_write().  The sectors written by
+   all the operations since the last commit form one transaction,
+   which the buffer cache holds back from the disk.
+
+   Committing a transaction first writes its sectors, one after
+   another, to the journal region at LOG_SECTOR, then the list of
+   their home sectors, ending with the journal header, which is
+   the commit point.  Only then are the
+   sectors written home, after which the header is cleared.  If
+   the system crashes before the commit point, none of the
+   transaction reaches the disk; if after it, log_init() copies
+   the logged sectors home again at the next boot.  Either way,
+   the metadata on disk is consistent.
+
+   Commits are grouped: a transaction collects operations until
+   it would no longer have room for another, or until
+   filesys_sync() commits it, which the buffer cache's flusher
+   does periodically.  The free map is written as part of each
+   commit, so the journal keeps room for all of its sectors.
+   Its size therefore follows the size of the device, as
+   computed by log_sectors().
+   Sectors freed by a transaction are not reused until it has
+   committed, since until then the metadata on disk may still
+   point to them.
+
+   File data is not journaled, so after a crash a file may hold
+   stale data where a write had not yet reached the disk.  A
+   file removed but still open at the time of a crash keeps its
+   sectors allocated. */
+
+/* Most sectors one operation may add to the running transaction,
+   checked by log_write().  inode_write_at() splits larger writes
+   into several operations, and dir_add() splits at most one
+   bucket, to stay within it. */
+#define MAX_OP_BLOCKS 10
+
+/* Room in a transaction for operations, besides the free map. */
+#define OP_ROOM (3 * MAX_OP_BLOCKS)
+
+/* Home sectors listed in the journal header, and in each of the
+   sectors that continue the list. */
+#define HEADER_HOMES ((BLOCK_SECTOR_SIZE - 8) / sizeof(block_sector_t))
+#define LIST_HOMES (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+#define LOG_MAGIC 0x4a524e4c /* Identifies a journal header. */
+
+/* Journal header, in sector LOG_SECTOR.  Any sectors that
+   continue its list of home sectors follow it, and then the
+   logged sectors. */
+struct log_header {
+  unsigned magic;                     /* LOG_MAGIC. */
+  uint32_t cnt;                       /* Number of logged sectors. */
+  block_sector_t home[HEADER_HOMES];  /* Home sector of each. */
+};
+
+static struct lock log_lock;
+static struct condition log_changed; /* Signaled on any state change. */
+static bool log_active;              /* Journal in use? */
+static bool committing;              /* Commit in progress? */
+static int outstanding;              /* Operations in progress. */
+static size_t reserved;              /* Blocks kept for the free map. */
+
+/* Journal layout, set by log_init(). */
+static size_t log_blocks;  /* Most sectors in one transaction. */
+static size_t list_cnt;    /* Sectors continuing the home list. */
+
+/* Running transaction. */
+static size_t log_cnt;
+static block_sector_t* log_home; /* Home sector of each. */
+
+/* Used only by the committing thread and by log_init(). */
+static struct log_header header;
+static uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+/* Returns the number of sectors in the free map file. */
+static size_t free_map_sectors(void) {
+  return DIV_ROUND_UP(DIV_ROUND_UP(block_size(fs_device), 8), BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the number of sectors needed to continue the header's
+   list of home sectors for BLOCKS logged sectors. */
+static size_t list_sectors(size_t blocks) {
+  return blocks > HEADER_HOMES ? DIV_ROUND_UP(blocks - HEADER_HOMES, LIST_HOMES) : 0;
+}
+
+/* Returns the number of sectors in the journal region at
+   LOG_SECTOR.  It depends only on the size of the file system
+   device, so it is the same whenever the device is mounted. */
+size_t log_sectors(void) {
+  size_t blocks = free_map_sectors() + OP_ROOM;
+
+  return 1 + list_sectors(blocks) + blocks;
+}
+
+/* Returns the sector in the journal that holds logged sector I. */
+static block_sector_t log_sector(size_t i) { return LOG_SECTOR + 1 + list_cnt + i; }
+
+/* Writes the journal header, listing the home sectors of the
+   first CNT logged sectors.  The sectors that continue the list
+   are written first, so that the header is the commit point. */
+static void write_header(size_t cnt) {
+  size_t i;
+
+  for (i = HEADER_HOMES; i < cnt; i += LIST_HOMES) {
+    size_t n = cnt - i < LIST_HOMES ? cnt - i : LIST_HOMES;
+
+    memset(buffer, 0, sizeof buffer);
+    memcpy(buffer, log_home + i, n * sizeof *log_home);
+    block_write(fs_device, LOG_SECTOR + 1 + (i - HEADER_HOMES) / LIST_HOMES, buffer);
+  }
+  header.magic = LOG_MAGIC;
+  header.cnt = cnt;
+  memcpy(header.home, log_home, (cnt < HEADER_HOMES ? cnt : HEADER_HOMES) * sizeof *log_home);
+  block_write(fs_device, LOG_SECTOR, &header);
+}
+
+/* Copies any committed transaction in the journal to its home
+   sectors, then empties the journal. */
+static void recover(void) {
+  size_t cnt, i;
+
+  block_read(fs_device, LOG_SECTOR, &header);
+  cnt = header.magic == LOG_MAGIC && header.cnt <= log_blocks ? header.cnt : 0;
+  memcpy(log_home, header.home, (cnt < HEADER_HOMES ? cnt : HEADER_HOMES) * sizeof *log_home);
+  for (i = HEADER_HOMES; i < cnt; i += LIST_HOMES) {
+    size_t n = cnt - i < LIST_HOMES ? cnt - i : LIST_HOMES;
+
+    block_read(fs_device, LOG_SECTOR + 1 + (i - HEADER_HOMES) / LIST_HOMES, buffer);
+    memcpy(log_home + i, buffer, n * sizeof *log_home);
+  }
+  for (i = 0; i < cnt; i++) {
+    block_read(fs_device, log_sector(i), buffer);
+    block_write(fs_device, log_home[i], buffer);
+  }
+  write_header(0);
+}
+
+/* Initializes the journal.  If FORMAT is false, first replays a
+   transaction that committed before the last shutdown or crash.
+   Must be called before any metadata is read. */
+void log_init(bool format) {
+  ASSERT(sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init(&log_lock);
+  cond_init(&log_changed);
+  reserved = free_map_sectors();
+  log_blocks = reserved + OP_ROOM;
+  list_cnt = list_sectors(log_blocks);
+  log_home = malloc(log_blocks * sizeof *log_home);
+  if (log_home == NULL)
+    PANIC("journal allocation failed--file system device is too large");
+
+  if (format)
+    write_header(0);
+  else
+    recover();
+  log_active = true;
+}
+
+/* Commits the running transaction.  Called with committing set
+   and no operations outstanding, without log_lock. */
+static void commit(void) {
+  struct thread* t = thread_current();
+  size_t i;
+
+  /* Log the free map's changes too.  Writing it is an operation
+     of its own, nested in the commit. */
+  t->log_depth++;
+  free_map_flush();
+  t->log_depth--;
+
+  if (log_cnt == 0)
+    return;
+  for (i = 0; i < log_cnt; i++) {
+    cache_read(log_home[i], buffer, 0, BLOCK_SECTOR_SIZE);
+    block_write(fs_device, log_sector(i), buffer);
+  }
+  write_header(log_cnt);
+  for (i = 0; i < log_cnt; i++)
+    cache_install(log_home[i]);
+  write_header(0);
+  log_cnt = 0;
+
+  /* Nothing on disk points to the sectors freed by the
+     transaction any more, so they may be reused. */
+  free_map_commit();
+}
+
+/* Waits for the running operations to end and commits their
+   transaction.  log_lock must be held; it is released during the
+   commit. */
+static void commit_locked(void) {
+  ASSERT(lock_held_by_current_thread(&log_lock));
+
+  while (committing)
+    cond_wait(&log_changed, &log_lock);
+  committing = true;
+  while (outstanding > 0)
+    cond_wait(&log_changed, &log_lock);
+  lock_release(&log_lock);
+  commit();
+  lock_acquire(&log_lock);
+  committing = false;
+  cond_broadcast(&log_changed, &log_lock);
+}
+
+/* Begins an operation that may log up to MAX_OP_BLOCKS sectors,
+   waiting for room in the running transaction if necessary.
+   Operations nest: an operation begun within another one is
+   part of the outer one. */
+void log_begin_op(void) {
+  struct thread* t = thread_current();
+
+  if (!log_active || t->log_depth++ > 0)
+    return;
+
+  lock_acquire(&log_lock);
+  for (;;) {
+    if (committing)
+      cond_wait(&log_changed, &log_lock);
+    else if (log_cnt + reserved + (outstanding + 1) * MAX_OP_BLOCKS > log_blocks) {
+      if (outstanding == 0)
+        commit_locked();
+      else
+        cond_wait(&log_changed, &log_lock);
+    } else
+      break;
+  }
+  outstanding++;
+  t->log_blocks = 0;
+  lock_release(&log_lock);
+}
+
+/* Ends the operation begun by the matching log_begin_op(). */
+void log_end_op(void) {
+  struct thread* t = thread_current();
+
+  if (!log_active || --t->log_depth > 0)
+    return;
+
+  lock_acquire(&log_lock);
+  outstanding--;
+  cond_broadcast(&log_changed, &log_lock);
+  lock_release(&log_lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within metadata
+   SECTOR, as part of the running transaction.  Must be called
+   within an operation.  Before the journal is initialized, as
+   while formatting, this is just cache_write(). */
+void log_write(block_sector_t sector, const void* buffer, size_t ofs, size_t size) {
+  struct thread* t = thread_current();
+  size_t i;
+
+  if (!log_active) {
+    cache_write(sector, buffer, ofs, size);
+    return;
+  }
+  ASSERT(t->log_depth > 0);
+
+  lock_acquire(&log_lock);
+  for (i = 0; i < log_cnt; i++)
+    if (log_home[i] == sector)
+      break;
+  if (i == log_cnt) {
+    /* The free map that commit() writes has room of its own. */
+    if (!committing)
+      t->log_blocks++;
+    ASSERT(t->log_blocks <= MAX_OP_BLOCKS);
+    if (log_cnt == log_blocks)
+      PANIC("journal transaction too large");
+    log_home[log_cnt++] = sector;
+  }
+  lock_release(&log_lock);
+
+  cache_write_logged(sector, buffer, ofs, size);
+}
+
+/* Commits the running transaction, so that every operation that
+   has ended is on disk. */
+void log_commit(void) {
+  if (!log_active)
+    return;
+  ASSERT(thread_current()->log_depth == 0);
+
+  lock_acquire(&log_lock);
+  commit_locked();
+  lock_release(&log_lock);
+}
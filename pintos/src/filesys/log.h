@@ -0,0 +1,15 @@
+#ifndef FILESYS_LOG_H
+#define FILESYS_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+size_t log_sectors(void);
+void log_init(bool format);
+void log_begin_op(void);
+void log_end_op(void);
+void log_write(block_sector_t, const void* buffer, size_t ofs, size_t size);
+void log_commit(void);
+
+#endif /* filesys/log.h */
@@ -0,0 +1,310 @@
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/vfs.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An in-memory file system.
+
+   Each file's data is kept in whole pages of kernel memory,
+   found through an array indexed by page number.  A page that
+   has never been written is a hole that reads as zeros.  Nothing
+   ever reaches a block device, so there is no journal and no
+   buffer cache, and everything is lost at shutdown.  A tmpfs
+   holds at most PAGE_LIMIT pages of data and TMPFS_INODES files
+   and directories. */
+
+/* Most files and directories in one tmpfs. */
+#define TMPFS_INODES 1024
+
+struct tmpfs;
+
+/* A file or directory. */
+struct tmpfs_node {
+  struct tmpfs* tmpfs;   /* File system it is on. */
+  enum inode_type type;  /* Kind of inode. */
+  struct rw_lock lock;   /* Protects the following. */
+  off_t length;          /* File size in bytes. */
+  uint8_t** pages;       /* Data pages, null pointers for holes. */
+  size_t page_cnt;       /* Number of elements in PAGES. */
+};
+
+/* A mounted tmpfs. */
+struct tmpfs {
+  struct fs fs;              /* Generic part. */
+  struct lock lock;          /* Protects the following. */
+  struct tmpfs_node** nodes; /* Nodes, by inode number less first. */
+  size_t page_cnt;           /* Pages of data in use. */
+  size_t page_limit;         /* Most pages of data. */
+};
+
+/* Allocates a node, to be set up by tmpfs_create(), and stores
+   its inode number in *INUMBERP. */
+static bool tmpfs_alloc_inumber(struct fs* fs, block_sector_t near UNUSED,
+                                block_sector_t* inumberp) {
+  struct tmpfs* tmpfs = fs->aux;
+  struct tmpfs_node* node;
+  size_t i;
+
+  node = calloc(1, sizeof *node);
+  if (node == NULL)
+    return false;
+  node->tmpfs = tmpfs;
+  rw_lock_init(&node->lock);
+
+  lock_acquire(&tmpfs->lock);
+  for (i = 0; i < TMPFS_INODES; i++)
+    if (tmpfs->nodes[i] == NULL) {
+      tmpfs->nodes[i] = node;
+      break;
+    }
+  lock_release(&tmpfs->lock);
+
+  if (i == TMPFS_INODES) {
+    free(node);
+    return false;
+  }
+  *inumberp = fs->first_inumber + i;
+  return true;
+}
+
+/* Frees the node of INUMBER and its data pages. */
+static void tmpfs_free_inumber(struct fs* fs, block_sector_t inumber) {
+  struct tmpfs* tmpfs = fs->aux;
+  struct tmpfs_node* node;
+  size_t i, freed = 0;
+
+  lock_acquire(&tmpfs->lock);
+  node = tmpfs->nodes[inumber - fs->first_inumber];
+  tmpfs->nodes[inumber - fs->first_inumber] = NULL;
+  lock_release(&tmpfs->lock);
+
+  for (i = 0; i < node->page_cnt; i++)
+    if (node->pages[i] != NULL) {
+      palloc_free_page(node->pages[i]);
+      freed++;
+    }
+  free(node->pages);
+  free(node);
+
+  lock_acquire(&tmpfs->lock);
+  tmpfs->page_cnt -= freed;
+  lock_release(&tmpfs->lock);
+}
+
+/* Sets up node INUMBER as a hole LENGTH bytes long. */
+static bool tmpfs_create(struct fs* fs, block_sector_t inumber, off_t length,
+                         enum inode_type type) {
+  struct tmpfs* tmpfs = fs->aux;
+  struct tmpfs_node* node;
+
+  ASSERT(length >= 0);
+
+  lock_acquire(&tmpfs->lock);
+  node = tmpfs->nodes[inumber - fs->first_inumber];
+  lock_release(&tmpfs->lock);
+  if (node == NULL)
+    return false;
+  node->type = type;
+  node->length = length;
+  return true;
+}
+
+/* Finds INODE's node. */
+static bool tmpfs_open(struct inode* inode) {
+  block_sector_t inumber = inode_get_inumber(inode);
+  struct fs* fs = vfs_find(inumber);
+  struct tmpfs* tmpfs = fs->aux;
+  struct tmpfs_node* node;
+
+  lock_acquire(&tmpfs->lock);
+  node = tmpfs->nodes[inumber - fs->first_inumber];
+  lock_release(&tmpfs->lock);
+  inode_set_aux(inode, node);
+  return node != NULL;
+}
+
+/* Frees removed INODE's node. */
+static void tmpfs_release(struct inode* inode) {
+  struct tmpfs_node* node = inode_get_aux(inode);
+  tmpfs_free_inumber(&node->tmpfs->fs, inode_get_inumber(inode));
+}
+
+static off_t tmpfs_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
+  struct tmpfs_node* node = inode_get_aux(inode);
+  uint8_t* buffer = buffer_;
+  off_t bytes_read = 0;
+
+  rw_lock_acquire(&node->lock, true);
+  if (offset < node->length && size > node->length - offset)
+    size = node->length - offset;
+  while (size > 0 && offset < node->length) {
+    size_t idx = offset / PGSIZE;
+    int page_ofs = offset % PGSIZE;
+    int chunk_size = size < PGSIZE - page_ofs ? size : PGSIZE - page_ofs;
+
+    if (idx < node->page_cnt && node->pages[idx] != NULL)
+      memcpy(buffer + bytes_read, node->pages[idx] + page_ofs, chunk_size);
+    else
+      memset(buffer + bytes_read, 0, chunk_size);
+
+    size -= chunk_size;
+    offset += chunk_size;
+    bytes_read += chunk_size;
+  }
+  rw_lock_release(&node->lock, true);
+  return bytes_read;
+}
+
+/* Makes sure NODE has data pages for bytes START through END - 1,
+   allocating zeroed pages for holes.  NODE's lock must be held
+   exclusively.  Returns false if memory runs out or the tmpfs is
+   full, leaving some of the pages allocated. */
+static bool fill_pages(struct tmpfs_node* node, off_t start, off_t end) {
+  struct tmpfs* tmpfs = node->tmpfs;
+  size_t idx, cnt = DIV_ROUND_UP(end, PGSIZE);
+
+  if (cnt > node->page_cnt) {
+    uint8_t** pages = realloc(node->pages, cnt * sizeof *pages);
+    if (pages == NULL)
+      return false;
+    memset(pages + node->page_cnt, 0, (cnt - node->page_cnt) * sizeof *pages);
+    node->pages = pages;
+    node->page_cnt = cnt;
+  }
+
+  for (idx = start / PGSIZE; idx < cnt; idx++) {
+    bool ok;
+
+    if (node->pages[idx] != NULL)
+      continue;
+    lock_acquire(&tmpfs->lock);
+    ok = tmpfs->page_cnt < tmpfs->page_limit;
+    if (ok)
+      tmpfs->page_cnt++;
+    lock_release(&tmpfs->lock);
+    if (ok && (node->pages[idx] = palloc_get_page(PAL_ZERO)) == NULL) {
+      lock_acquire(&tmpfs->lock);
+      tmpfs->page_cnt--;
+      lock_release(&tmpfs->lock);
+      ok = false;
+    }
+    if (!ok)
+      return false;
+  }
+  return true;
+}
+
+static off_t tmpfs_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
+  struct tmpfs_node* node = inode_get_aux(inode);
+  const uint8_t* buffer = buffer_;
+  off_t bytes_written = 0;
+
+  if (size <= 0 || offset < 0 || offset + size < offset || !inode_write_begin(inode))
+    return 0;
+  rw_lock_acquire(&node->lock, false);
+  while (size > 0) {
+    int page_ofs = offset % PGSIZE;
+    int chunk_size = size < PGSIZE - page_ofs ? size : PGSIZE - page_ofs;
+
+    if (!fill_pages(node, offset, offset + chunk_size))
+      break;
+    memcpy(node->pages[offset / PGSIZE] + page_ofs, buffer + bytes_written, chunk_size);
+
+    size -= chunk_size;
+    offset += chunk_size;
+    bytes_written += chunk_size;
+  }
+  if (offset > node->length)
+    node->length = offset;
+  rw_lock_release(&node->lock, false);
+  inode_write_end(inode);
+  return bytes_written;
+}
+
+/* Allocates pages for the SIZE bytes of INODE at OFFSET.  Pages
+   are not physically contiguous, but since reading them takes no
+   seeks, *CONTIGUOUS is always set to true. */
+static bool tmpfs_allocate(struct inode* inode, off_t offset, off_t size, bool* contiguous) {
+  struct tmpfs_node* node = inode_get_aux(inode);
+  bool success;
+
+  *contiguous = true;
+  if (offset < 0)
+    return false;
+  if (size <= 0)
+    return size == 0;
+  if (offset + size < offset || !inode_write_begin(inode))
+    return false;
+  rw_lock_acquire(&node->lock, false);
+  success = fill_pages(node, offset, offset + size);
+  if (success && offset + size > node->length)
+    node->length = offset + size;
+  rw_lock_release(&node->lock, false);
+  inode_write_end(inode);
+  return success;
+}
+
+static off_t tmpfs_length(const struct inode* inode) {
+  const struct tmpfs_node* node = inode_get_aux(inode);
+  return node->length;
+}
+
+static bool tmpfs_is_dir(const struct inode* inode) {
+  const struct tmpfs_node* node = inode_get_aux(inode);
+  return node->type == INODE_DIRECTORY;
+}
+
+static const struct fs_ops tmpfs_ops = {
+    .alloc_inumber = tmpfs_alloc_inumber,
+    .free_inumber = tmpfs_free_inumber,
+    .create = tmpfs_create,
+    .open = tmpfs_open,
+    .release = tmpfs_release,
+    .read_at = tmpfs_read_at,
+    .write_at = tmpfs_write_at,
+    .allocate = tmpfs_allocate,
+    .length = tmpfs_length,
+    .is_dir = tmpfs_is_dir,
+};
+
+/* Mounts a new, empty tmpfs of at most PAGE_LIMIT pages of data
+   on directory PATH, creating PATH if it does not exist.
+   Returns true if successful, false on failure. */
+bool tmpfs_mount(const char* path, size_t page_limit) {
+  struct tmpfs* tmpfs;
+  struct dir* dir;
+
+  dir = filesys_open_dir(path);
+  if (dir == NULL && !filesys_mkdir(path))
+    return false;
+  dir_close(dir);
+
+  tmpfs = malloc(sizeof *tmpfs);
+  if (tmpfs == NULL)
+    return false;
+  tmpfs->nodes = calloc(TMPFS_INODES, sizeof *tmpfs->nodes);
+  if (tmpfs->nodes == NULL) {
+    free(tmpfs);
+    return false;
+  }
+  tmpfs->fs.ops = &tmpfs_ops;
+  tmpfs->fs.aux = tmpfs;
+  lock_init(&tmpfs->lock);
+  tmpfs->page_cnt = 0;
+  tmpfs->page_limit = page_limit;
+
+  if (!vfs_mount(path, &tmpfs->fs, TMPFS_INODES)) {
+    free(tmpfs->nodes);
+    free(tmpfs);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,9 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool tmpfs_mount(const char* path, size_t page_limit);
+
+#endif /* filesys/tmpfs.h */
@@ -0,0 +1,130 @@
+#include "filesys/vfs.h"
+#include <debug.h>
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+/* Virtual file system switch.
+
+   The inode layer in inode.c is shared by every file system.  It
+   keeps the table of in-memory inodes, their open counts, locks,
+   and write denial, and hands everything that depends on where
+   an inode's data lives to the operations of the file system it
+   belongs to, found from its inode number.  Directories are
+   stored in the format of directory.c on every file system, on
+   top of those operations, so looking up and listing names work
+   the same everywhere.
+
+   The disk file system is mounted at the root.  Another file
+   system is mounted on a directory of one already mounted,
+   which it then covers: looking up the directory's name yields
+   the root of the mounted file system instead, and ".." in that
+   root leads back to the covered directory's parent. */
+
+/* Most file systems mounted at once. */
+#define MOUNT_MAX 8
+
+/* First inode number given to file systems other than disk_fs.
+   Sector numbers are smaller, since the disk holds fewer. */
+#define MOUNT_INUMBER_BASE 0x40000000
+
+/* Mounted file systems, disk_fs first.  File systems are only
+   mounted while booting, so the table is read without locking;
+   mount_lock serializes mounting. */
+static struct fs* mounts[MOUNT_MAX];
+static size_t mount_cnt;
+static struct lock mount_lock;
+
+/* Mounts disk_fs at the root. */
+void vfs_init(void) {
+  ASSERT(block_size(fs_device) <= MOUNT_INUMBER_BASE);
+
+  lock_init(&mount_lock);
+  disk_fs.first_inumber = 0;
+  disk_fs.inumber_cnt = block_size(fs_device);
+  disk_fs.root = ROOT_DIR_SECTOR;
+  disk_fs.covered = 0;
+  mounts[0] = &disk_fs;
+  mount_cnt = 1;
+}
+
+/* Returns the file system that inode number INUMBER belongs to,
+   or a null pointer if none does. */
+struct fs* vfs_find(block_sector_t inumber) {
+  size_t i;
+
+  for (i = 0; i < mount_cnt; i++)
+    if (inumber - mounts[i]->first_inumber < mounts[i]->inumber_cnt)
+      return mounts[i];
+  return NULL;
+}
+
+/* Returns the inode number of the root of the file system
+   mounted on directory INUMBER, or INUMBER itself if none is. */
+block_sector_t vfs_cross(block_sector_t inumber) {
+  size_t i;
+
+  for (i = 1; i < mount_cnt; i++)
+    if (mounts[i]->covered == inumber)
+      return mounts[i]->root;
+  return inumber;
+}
+
+/* Returns true if a file system is mounted on directory
+   INUMBER. */
+bool vfs_is_covered(block_sector_t inumber) { return vfs_cross(inumber) != inumber; }
+
+/* Mounts FS, which may use INUMBER_CNT inode numbers, on the
+   existing directory PATH, creating its empty root directory.
+   Returns true if successful, false if PATH is not a directory
+   other than the root or is already covered, or if too many
+   file systems are mounted. */
+bool vfs_mount(const char* path, struct fs* fs, block_sector_t inumber_cnt) {
+  struct dir* dir;
+  struct inode* parent;
+  block_sector_t covered;
+  bool success = false;
+
+  dir = filesys_open_dir(path);
+  if (dir == NULL)
+    return false;
+  covered = inode_get_inumber(dir_get_inode(dir));
+  if (!dir_lookup(dir, "..", &parent)) {
+    dir_close(dir);
+    return false;
+  }
+
+  lock_acquire(&mount_lock);
+  if (mount_cnt < MOUNT_MAX && covered != ROOT_DIR_SECTOR && !vfs_is_covered(covered)) {
+    const struct fs* last = mounts[mount_cnt - 1];
+
+    fs->first_inumber = mount_cnt == 1 ? MOUNT_INUMBER_BASE : last->first_inumber + last->inumber_cnt;
+    fs->inumber_cnt = inumber_cnt;
+    fs->covered = 0;
+    mounts[mount_cnt++] = fs;
+
+    /* The root only becomes reachable once COVERED is set. */
+    if (!fs->ops->alloc_inumber(fs, 0, &fs->root))
+      mount_cnt--;
+    else if (!dir_create(fs->root, inode_get_inumber(parent), 16)) {
+      /* Free the root's inode number, and whatever dir_create()
+         did allocate, by removing it, as filesys_mkdir() does,
+         so that no closed inode is left cached under it. */
+      struct inode* root = inode_open(fs->root);
+      if (root != NULL) {
+        inode_remove(root);
+        inode_close(root);
+      } else
+        fs->ops->free_inumber(fs, fs->root);
+      mount_cnt--;
+    } else {
+      fs->covered = covered;
+      success = true;
+    }
+  }
+  lock_release(&mount_lock);
+
+  inode_close(parent);
+  dir_close(dir);
+  return success;
+}
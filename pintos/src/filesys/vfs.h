@@ -0,0 +1,74 @@
+#ifndef FILESYS_VFS_H
+#define FILESYS_VFS_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/inode.h"
+#include "filesys/off_t.h"
+
+struct fs;
+
+/* Operations of one kind of file system on its inodes.  The
+   operations marked optional may be null pointers. */
+struct fs_ops {
+  /* Allocates an unused inode number, near NEAR if that helps,
+     and stores it into *INUMBERP. */
+  bool (*alloc_inumber)(struct fs*, block_sector_t near, block_sector_t* inumberp);
+
+  /* Frees INUMBER, allocated but never created. */
+  void (*free_inumber)(struct fs*, block_sector_t inumber);
+
+  /* Creates inode INUMBER with LENGTH bytes of zeros. */
+  bool (*create)(struct fs*, block_sector_t inumber, off_t length, enum inode_type);
+
+  /* Prepares a newly opened INODE for use.  Returns false if it
+     does not exist. */
+  bool (*open)(struct inode*);
+
+  /* Frees the inode number and data of INODE, which was removed
+     and has just been closed for the last time. */
+  void (*release)(struct inode*);
+
+  off_t (*read_at)(struct inode*, void*, off_t size, off_t offset);
+  off_t (*write_at)(struct inode*, const void*, off_t size, off_t offset);
+  bool (*allocate)(struct inode*, off_t offset, off_t size, bool* contiguous);
+  off_t (*length)(const struct inode*);
+  bool (*is_dir)(const struct inode*);
+
+  /* Optional. */
+  void (*read_ahead)(struct inode*, off_t start, off_t end);
+  off_t (*copy_range)(struct inode* in, off_t in_ofs, struct inode* out, off_t out_ofs,
+                      off_t size);
+  int (*fragments)(struct inode*);
+  bool (*defragment)(struct inode*);
+};
+
+/* A file system.  Its inode numbers are FIRST_INUMBER up to
+   FIRST_INUMBER + INUMBER_CNT, and no other file system's, so
+   that an inode number also tells which file system it is on. */
+struct fs {
+  const struct fs_ops* ops;    /* Operations. */
+  block_sector_t first_inumber; /* First inode number. */
+  block_sector_t inumber_cnt;   /* Number of inode numbers. */
+  block_sector_t root;          /* Inode number of root directory. */
+  block_sector_t covered;       /* Directory mounted on, or 0. */
+  void* aux;                    /* File system's own data. */
+};
+
+/* The file system on fs_device, implemented in inode.c, whose
+   inode numbers are sector numbers. */
+extern struct fs disk_fs;
+
+void vfs_init(void);
+bool vfs_mount(const char* path, struct fs*, block_sector_t inumber_cnt);
+struct fs* vfs_find(block_sector_t inumber);
+block_sector_t vfs_cross(block_sector_t inumber);
+bool vfs_is_covered(block_sector_t inumber);
+
+/* Generic inode state for use by file systems. */
+void* inode_get_aux(const struct inode*);
+void inode_set_aux(struct inode*, void*);
+bool inode_write_begin(struct inode*);
+void inode_write_end(struct inode*);
+
+#endif /* filesys/vfs.h */
@@ -0,0 +1,20 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdint.h>
+
+/* A directory entry as stored by the getdents system call.
+   Entries are packed one after another, each starting on a
+   4-byte boundary, D_RECLEN bytes apart. */
+struct dirent {
+  uint32_t d_ino;    /* Inode number. */
+  uint16_t d_reclen; /* Bytes from this entry to the next. */
+  uint8_t d_type;    /* DT_REG or DT_DIR. */
+  char d_name[];     /* Null-terminated file name. */
+};
+
+/* Values of d_type. */
+#define DT_REG 1 /* Ordinary file. */
+#define DT_DIR 2 /* Directory. */
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_FSSTAT_H
+#define __LIB_FSSTAT_H
+
+/* Number of extent size classes.  Class N counts free extents of
+   2**N through 2**(N+1) - 1 sectors. */
+#define FSSTAT_CLASSES 32
+
+/* Free space on the file system, as reported by the fsstat
+   system call. */
+struct fsstat {
+  unsigned free_sectors;             /* Free sectors. */
+  unsigned reserved_sectors;         /* Free sectors set aside for delayed data. */
+  unsigned free_extents;             /* Maximal runs of free sectors. */
+  unsigned largest_extent;           /* Sectors in the longest run. */
+  unsigned extents[FSSTAT_CLASSES]; /* Runs in each size class. */
+};
+
+#endif /* lib/fsstat.h */
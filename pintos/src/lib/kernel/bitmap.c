@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -284,6 +285,21 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Copies the SIZE bytes of B's file form starting at byte OFS
+   into BUFFER, clipped to the end of B, so that they can be
+   written to the same place in a file later.  Returns the number
+   of bytes copied. */
+off_t bitmap_copy_part(const struct bitmap* b, void* buffer, off_t ofs, off_t size) {
+  off_t total = byte_cnt(b->bit_cnt);
+
+  if (ofs >= total)
+    return 0;
+  if (size > total - ofs)
+    size = total - ofs;
+  memcpy(buffer, (const char*)b->bits + ofs, size);
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -39,7 +39,19 @@ enum {
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* File system extensions. */
+  SYS_FALLOCATE,       /* Preallocates space for a file. */
+  SYS_GETDENTS,        /* Reads many directory entries at once. */
+  SYS_COPY_FILE_RANGE, /* Copies data between files in the kernel. */
+  SYS_FSSTAT,          /* Reports how free space is broken up. */
+  SYS_FRAGMENTS,       /* Counts the fragments of a file. */
+  SYS_DEFRAG,          /* Makes a file contiguous. */
+
+  /* Memory extensions, numbered after everything else so that
+     existing binaries keep working. */
+  SYS_SBRK /* Move the end of the heap. */
 };
 
 #endif /* lib/syscall-nr.h */
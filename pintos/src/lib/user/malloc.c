@@ -0,0 +1,405 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A user-space heap allocator on top of sbrk().
+
+   Requests of up to MAX_SMALL bytes are rounded up to one of
+   NUM_CLASSES power-of-2 block sizes.  Each thread keeps a cache
+   of free blocks for every size class, so that the common
+   malloc() and free() touch only that cache: no lock and no
+   system call.  A cache that runs dry takes a batch of blocks
+   from the central free list for its class, under a user lock,
+   and the central list in turn carves fresh blocks out of
+   CHUNK_SIZE bytes obtained from sbrk().  A cache that grows too
+   long gives a batch back to the central list.
+
+   Pintos has no thread-local storage, so a thread finds its
+   cache through its stack page instead.  No two running threads
+   share a stack page, and the page number selects a cache slot
+   that the thread claims on first use.  A thread whose slot is
+   already claimed by another stack page uses the central lists
+   directly.
+
+   Larger requests are rounded up to whole pages and served
+   first-fit from an address-ordered list of free spans.  Freed
+   spans are coalesced with their neighbors, and a free span at
+   the top of the heap is returned with a negative sbrk(). */
+
+#define PAGE_SIZE 4096       /* Bytes per page. */
+#define NUM_CLASSES 9        /* Block sizes 16, 32, ..., 4096. */
+#define LARGE_CLASS NUM_CLASSES
+#define CHUNK_SIZE (4 * PAGE_SIZE) /* Bytes carved at a time. */
+#define CACHE_SLOTS 128      /* At least one per thread. */
+
+/* Header in front of every allocated block. */
+struct block {
+  size_t size;    /* Bytes usable by the caller. */
+  unsigned magic; /* BLOCK_MAGIC plus size class. */
+};
+
+#define BLOCK_MAGIC 0x9a548e00
+#define MAX_SMALL ((16u << (NUM_CLASSES - 1)) - sizeof(struct block))
+
+/* A free small block. */
+struct free_block {
+  struct block hdr;        /* Header, kept while free. */
+  struct free_block* next; /* Next free block of same class. */
+};
+
+/* A free large span of whole pages. */
+struct span {
+  struct block hdr;  /* Header; span is hdr.size + header bytes. */
+  struct span* next; /* Next free span, in address order. */
+};
+
+/* Per-thread cache of free small blocks. */
+struct cache {
+  volatile uintptr_t owner;              /* Stack page of owner, or 0. */
+  struct free_block* free[NUM_CLASSES]; /* Free blocks per class. */
+  unsigned cnt[NUM_CLASSES];            /* Length of each list. */
+};
+
+static struct cache caches[CACHE_SLOTS];
+
+/* Central lists, protected by the user lock whose number plus
+   one is in heap_lock, or 0 before the lock is created. */
+static volatile uintptr_t heap_lock;
+static struct free_block* central[NUM_CLASSES];
+static struct span* spans;
+
+/* Sets *P to NEW if it equals OLD, atomically.  Returns true if
+   it did so. */
+static bool atomic_cas(volatile uintptr_t* p, uintptr_t old, uintptr_t new) {
+  uintptr_t prev;
+  asm volatile("lock cmpxchgl %2, %1" : "=a"(prev), "+m"(*p) : "r"(new), "0"(old) : "memory");
+  return prev == old;
+}
+
+/* Returns the central lock, creating it on first use.  Threads
+   that race to create it each create one, and all but the lock
+   published first go unused; waiting for the winner instead
+   could spin forever under priority scheduling. */
+static lock_t heap_lock_get(void) {
+  if (heap_lock == 0) {
+    lock_t lock;
+
+    if (!lock_init(&lock))
+      exit(-1);
+    atomic_cas(&heap_lock, 0, (uintptr_t)(unsigned char)lock + 1);
+  }
+  return heap_lock - 1;
+}
+
+/* Acquires the central lock.  A waiter sleeps in the kernel, so
+   that the holder runs even if it has lower priority. */
+static void heap_acquire(void) {
+  lock_t lock = heap_lock_get();
+  lock_acquire(&lock);
+}
+
+/* Releases the central lock. */
+static void heap_release(void) {
+  lock_t lock = heap_lock_get();
+  lock_release(&lock);
+}
+
+/* Returns the number of bytes in a block of class CLASS,
+   including its header. */
+static size_t class_size(unsigned class) { return 16u << class; }
+
+/* Returns the smallest class whose blocks hold SIZE bytes. */
+static unsigned size_to_class(size_t size) {
+  unsigned class = 0;
+  while (class_size(class) - sizeof(struct block) < size)
+    class++;
+  return class;
+}
+
+/* Returns the number of blocks of CLASS that move between a
+   thread cache and the central list at a time. */
+static unsigned batch_size(unsigned class) {
+  unsigned n = PAGE_SIZE / class_size(class);
+  return n < 2 ? 2 : n > 32 ? 32 : n;
+}
+
+/* Returns the running thread's cache, claiming it on first use,
+   or a null pointer if its slot belongs to another thread. */
+static struct cache* get_cache(void) {
+  int marker;
+  uintptr_t page = (uintptr_t)&marker / PAGE_SIZE;
+  struct cache* c = &caches[page % CACHE_SLOTS];
+
+  if (c->owner == page || atomic_cas(&c->owner, 0, page))
+    return c;
+  return NULL;
+}
+
+/* Extends the heap by BYTES, starting on a page boundary.
+   Returns the start of the new space, or a null pointer if the
+   kernel refuses. */
+static void* more_core(size_t bytes) {
+  uint8_t* brk = sbrk(0);
+  size_t pad;
+
+  if (brk == (void*)-1)
+    return NULL;
+  pad = ROUND_UP((uintptr_t)brk, PAGE_SIZE) - (uintptr_t)brk;
+  if (sbrk(pad + bytes) == (void*)-1)
+    return NULL;
+  return brk + pad;
+}
+
+/* Carves a fresh chunk into blocks of CLASS on the central list.
+   Returns false if the heap cannot grow.  The central lock must
+   be held. */
+static bool carve(unsigned class) {
+  size_t size = class_size(class);
+  uint8_t* chunk = more_core(CHUNK_SIZE);
+  size_t ofs;
+
+  if (chunk == NULL)
+    return false;
+  for (ofs = 0; ofs + size <= CHUNK_SIZE; ofs += size) {
+    struct free_block* b = (struct free_block*)(chunk + ofs);
+    b->hdr.size = size - sizeof(struct block);
+    b->hdr.magic = BLOCK_MAGIC | class;
+    b->next = central[class];
+    central[class] = b;
+  }
+  return true;
+}
+
+/* Moves up to a batch of CLASS blocks from the central list to
+   cache C. */
+static void refill(struct cache* c, unsigned class) {
+  unsigned n;
+
+  heap_acquire();
+  for (n = batch_size(class); n > 0; n--) {
+    struct free_block* b = central[class];
+    if (b == NULL && (!carve(class) || (b = central[class]) == NULL))
+      break;
+    central[class] = b->next;
+    b->next = c->free[class];
+    c->free[class] = b;
+    c->cnt[class]++;
+  }
+  heap_release();
+}
+
+/* Moves a batch of CLASS blocks from cache C to the central
+   list. */
+static void drain(struct cache* c, unsigned class) {
+  unsigned n;
+
+  heap_acquire();
+  for (n = batch_size(class); n > 0 && c->free[class] != NULL; n--) {
+    struct free_block* b = c->free[class];
+    c->free[class] = b->next;
+    c->cnt[class]--;
+    b->next = central[class];
+    central[class] = b;
+  }
+  heap_release();
+}
+
+/* Allocates a block of CLASS. */
+static struct block* small_alloc(unsigned class) {
+  struct cache* c = get_cache();
+  struct free_block* b;
+
+  if (c != NULL) {
+    if (c->free[class] == NULL)
+      refill(c, class);
+    b = c->free[class];
+    if (b != NULL) {
+      c->free[class] = b->next;
+      c->cnt[class]--;
+    }
+  } else {
+    heap_acquire();
+    if (central[class] == NULL)
+      carve(class);
+    b = central[class];
+    if (b != NULL)
+      central[class] = b->next;
+    heap_release();
+  }
+  return b != NULL ? &b->hdr : NULL;
+}
+
+/* Frees block B of CLASS. */
+static void small_free(struct block* b_, unsigned class) {
+  struct free_block* b = (struct free_block*)b_;
+  struct cache* c = get_cache();
+
+  if (c != NULL) {
+    b->next = c->free[class];
+    c->free[class] = b;
+    if (++c->cnt[class] > 2 * batch_size(class))
+      drain(c, class);
+  } else {
+    heap_acquire();
+    b->next = central[class];
+    central[class] = b;
+    heap_release();
+  }
+}
+
+/* Returns the number of bytes spanned by S, including its
+   header. */
+static size_t span_bytes(const struct span* s) { return s->hdr.size + sizeof(struct block); }
+
+/* Allocates a block of whole pages holding SIZE bytes. */
+static struct block* large_alloc(size_t size) {
+  size_t bytes = ROUND_UP(size + sizeof(struct block), PAGE_SIZE);
+  struct span **link, *s;
+
+  if (bytes < size)
+    return NULL;
+
+  heap_acquire();
+  for (link = &spans; (s = *link) != NULL; link = &s->next)
+    if (span_bytes(s) >= bytes)
+      break;
+  if (s != NULL) {
+    /* First fit; split off the unused tail. */
+    if (span_bytes(s) > bytes) {
+      struct span* rest = (struct span*)((uint8_t*)s + bytes);
+      rest->hdr.size = span_bytes(s) - bytes - sizeof(struct block);
+      rest->hdr.magic = BLOCK_MAGIC | LARGE_CLASS;
+      rest->next = s->next;
+      *link = rest;
+    } else
+      *link = s->next;
+  } else
+    s = more_core(bytes);
+  heap_release();
+
+  if (s == NULL)
+    return NULL;
+  s->hdr.size = bytes - sizeof(struct block);
+  s->hdr.magic = BLOCK_MAGIC | LARGE_CLASS;
+  return &s->hdr;
+}
+
+/* Frees large block B, coalescing it with adjacent free spans
+   and returning it to the kernel if it ends at the break. */
+static void large_free(struct block* b) {
+  struct span* s = (struct span*)b;
+  struct span *before = NULL, **before_link = NULL, **link;
+
+  heap_acquire();
+  for (link = &spans; *link != NULL && *link < s; link = &(*link)->next) {
+    before = *link;
+    before_link = link;
+  }
+  s->next = *link;
+  *link = s;
+
+  if (s->next != NULL && (uint8_t*)s + span_bytes(s) == (uint8_t*)s->next) {
+    s->hdr.size += span_bytes(s->next);
+    s->next = s->next->next;
+  }
+  if (before != NULL && (uint8_t*)before + span_bytes(before) == (uint8_t*)s) {
+    before->hdr.size += span_bytes(s);
+    before->next = s->next;
+    s = before;
+    link = before_link;
+  }
+
+  if (s->next == NULL && (uint8_t*)s + span_bytes(s) == sbrk(0)) {
+    *link = NULL;
+    sbrk(-(intptr_t)span_bytes(s));
+  }
+  heap_release();
+}
+
+/* Returns the header of the block at P, which must have been
+   returned by malloc(), calloc(), or realloc(). */
+static struct block* get_block(void* p) {
+  struct block* b = (struct block*)p - 1;
+  ASSERT((b->magic & ~0xff) == BLOCK_MAGIC);
+  ASSERT((b->magic & 0xff) <= LARGE_CLASS);
+  return b;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void* malloc(size_t size) {
+  struct block* b;
+
+  if (size == 0)
+    return NULL;
+  if (size <= MAX_SMALL)
+    b = small_alloc(size_to_class(size));
+  else
+    b = large_alloc(size);
+  return b != NULL ? b + 1 : NULL;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void* calloc(size_t a, size_t b) {
+  void* p;
+  size_t size;
+
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  size = a * b;
+
+  p = malloc(size);
+  if (p != NULL)
+    memset(p, 0, size);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void* realloc(void* old_block, size_t new_size) {
+  struct block* b;
+  void* new_block;
+
+  if (new_size == 0) {
+    free(old_block);
+    return NULL;
+  }
+  if (old_block == NULL)
+    return malloc(new_size);
+
+  b = get_block(old_block);
+  if (new_size <= b->size)
+    return old_block;
+
+  new_block = malloc(new_size);
+  if (new_block != NULL) {
+    memcpy(new_block, old_block, b->size);
+    free(old_block);
+  }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void free(void* p) {
+  struct block* b;
+  unsigned class;
+
+  if (p == NULL)
+    return;
+  b = get_block(p);
+  class = b->magic & 0xff;
+  if (class == LARGE_CLASS)
+    large_free(b);
+  else
+    small_free(b, class);
+}
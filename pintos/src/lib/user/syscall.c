@@ -106,6 +106,8 @@ mapid_t mmap(int fd, void* addr) { return syscall2(SYS_MMAP, fd, addr); }
 
 void munmap(mapid_t mapid) { syscall1(SYS_MUNMAP, mapid); }
 
+void* sbrk(intptr_t increment) { return (void*)syscall1(SYS_SBRK, increment); }
+
 bool chdir(const char* dir) { return syscall1(SYS_CHDIR, dir); }
 
 bool mkdir(const char* dir) { return syscall1(SYS_MKDIR, dir); }
@@ -116,6 +118,24 @@ bool isdir(int fd) { return syscall1(SYS_ISDIR, fd); }
 
 int inumber(int fd) { return syscall1(SYS_INUMBER, fd); }
 
+int fallocate(int fd, unsigned offset, unsigned length) {
+  return syscall3(SYS_FALLOCATE, fd, offset, length);
+}
+
+int getdents(int fd, void* buffer, unsigned size) {
+  return syscall3(SYS_GETDENTS, fd, buffer, size);
+}
+
+int copy_file_range(int in_fd, int out_fd, unsigned size) {
+  return syscall3(SYS_COPY_FILE_RANGE, in_fd, out_fd, size);
+}
+
+bool fsstat(struct fsstat* stats) { return syscall1(SYS_FSSTAT, stats); }
+
+int fragments(int fd) { return syscall1(SYS_FRAGMENTS, fd); }
+
+int defrag(int fd) { return syscall1(SYS_DEFRAG, fd); }
+
 double compute_e(int n) { return (double)syscall1f(SYS_COMPUTE_E, n); }
 
 tid_t sys_pthread_create(stub_fun sfun, pthread_fun tfun, const void* arg) {
@@ -2,7 +2,10 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
+#include <dirent.h>
+#include <fsstat.h>
 #include <pthread.h>
 
 /* Process identifier. */
@@ -54,6 +57,7 @@ tid_t get_tid(void);
 /* Project 3 and optionally project 4. */
 mapid_t mmap(int fd, void* addr);
 void munmap(mapid_t);
+void* sbrk(intptr_t increment);
 
 /* Project 4 only. */
 bool chdir(const char* dir);
@@ -62,4 +66,12 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* File system extensions. */
+int fallocate(int fd, unsigned offset, unsigned length);
+int getdents(int fd, void* buffer, unsigned size);
+int copy_file_range(int in_fd, int out_fd, unsigned size);
+bool fsstat(struct fsstat*);
+int fragments(int fd);
+int defrag(int fd);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,17 @@
+/* Tries to preallocate space in a directory, which must fail,
+   and checks that the directory still works afterward. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int fd;
+
+  CHECK(mkdir("abc"), "mkdir \"abc\"");
+  CHECK((fd = open("abc")) > 1, "open \"abc\"");
+  CHECK(fallocate(fd, 0, 8192) == -1, "fallocate \"abc\" (must return -1)");
+  msg("close \"abc\"");
+  close(fd);
+  CHECK(create("abc/xyz", 0), "create \"abc/xyz\"");
+}
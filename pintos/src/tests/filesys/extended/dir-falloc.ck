@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-falloc) begin
+(dir-falloc) mkdir "abc"
+(dir-falloc) open "abc"
+(dir-falloc) fallocate "abc" (must return -1)
+(dir-falloc) close "abc"
+(dir-falloc) create "abc/xyz"
+(dir-falloc) end
+EOF
+pass;
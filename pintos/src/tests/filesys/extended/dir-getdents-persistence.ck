@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($a) = {'sub' => {}};
+$a->{"f$_"} = [''] foreach 0...39;
+check_archive ({'a' => $a});
+pass;
@@ -0,0 +1,68 @@
+/* Creates a directory holding many files and a subdirectory,
+   then lists it with getdents() through a small buffer and
+   checks that every entry is returned once, with its type and
+   inode number. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+void test_main(void) {
+  bool seen[FILE_CNT + 1];
+  char buf[64];
+  char name[16];
+  int dir_fd, size, sub_fd, i;
+  int entry_cnt = 0;
+
+  CHECK(mkdir("a"), "mkdir \"a\"");
+  CHECK(mkdir("a/sub"), "mkdir \"a/sub\"");
+  msg("creating a/f0...a/f%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++) {
+    snprintf(name, sizeof name, "a/f%d", i);
+    if (!create(name, 0))
+      fail("create \"%s\" failed", name);
+  }
+
+  CHECK((dir_fd = open("a")) > 1, "open \"a\"");
+  CHECK((sub_fd = open("a/sub")) > 1, "open \"a/sub\"");
+  CHECK(getdents(dir_fd, buf, 8) == -1, "getdents with a tiny buffer fails");
+
+  msg("listing \"a\"");
+  memset(seen, 0, sizeof seen);
+  while ((size = getdents(dir_fd, buf, sizeof buf)) > 0) {
+    int ofs;
+
+    for (ofs = 0; ofs < size; ofs += ((struct dirent*)(buf + ofs))->d_reclen) {
+      struct dirent* d = (struct dirent*)(buf + ofs);
+      int idx;
+
+      if (!strcmp(d->d_name, "sub")) {
+        if (d->d_type != DT_DIR)
+          fail("\"sub\" is not reported as a directory");
+        if ((int)d->d_ino != inumber(sub_fd))
+          fail("\"sub\" has the wrong inode number");
+        idx = FILE_CNT;
+      } else {
+        if (d->d_name[0] != 'f' || (idx = atoi(d->d_name + 1)) < 0 || idx >= FILE_CNT)
+          fail("unexpected entry \"%s\"", d->d_name);
+        if (d->d_type != DT_REG)
+          fail("\"%s\" is not reported as a file", d->d_name);
+      }
+      if (seen[idx])
+        fail("\"%s\" listed twice", d->d_name);
+      seen[idx] = true;
+      entry_cnt++;
+    }
+  }
+  CHECK(size == 0, "getdents reached end of directory");
+  CHECK(entry_cnt == FILE_CNT + 1, "listed %d entries", FILE_CNT + 1);
+  msg("close \"a/sub\"");
+  close(sub_fd);
+  msg("close \"a\"");
+  close(dir_fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) mkdir "a/sub"
+(dir-getdents) creating a/f0...a/f39
+(dir-getdents) open "a"
+(dir-getdents) open "a/sub"
+(dir-getdents) getdents with a tiny buffer fails
+(dir-getdents) listing "a"
+(dir-getdents) getdents reached end of directory
+(dir-getdents) listed 41 entries
+(dir-getdents) close "a/sub"
+(dir-getdents) close "a"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Runs with a tmpfs mounted on /tmp.  Creates a file and a
+   directory there, checks that ".." leads back out of the mount,
+   that the mount point cannot be removed, and copies the file
+   onto the disk. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[6000];
+
+void test_main(void) {
+  int fd, root_fd, copy_fd;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK(create("/tmp/scratch", 0), "create \"/tmp/scratch\"");
+  CHECK((fd = open("/tmp/scratch")) > 1, "open \"/tmp/scratch\"");
+  CHECK(write(fd, buf, sizeof buf) == sizeof buf, "write \"/tmp/scratch\"");
+  msg("close \"/tmp/scratch\"");
+  close(fd);
+  check_file("/tmp/scratch", buf, sizeof buf);
+
+  CHECK(mkdir("/tmp/sub"), "mkdir \"/tmp/sub\"");
+  CHECK(chdir("/tmp/sub"), "chdir \"/tmp/sub\"");
+  CHECK((fd = open("../..")) > 1, "open \"../..\"");
+  CHECK((root_fd = open("/")) > 1, "open \"/\"");
+  CHECK(inumber(fd) == inumber(root_fd), "\"../..\" is \"/\"");
+  msg("close \"../..\"");
+  close(fd);
+  msg("close \"/\"");
+  close(root_fd);
+  CHECK(chdir("/"), "chdir \"/\"");
+  CHECK(!remove("/tmp"), "remove \"/tmp\" (must fail)");
+
+  CHECK(create("/copy", 0), "create \"/copy\"");
+  CHECK((fd = open("/tmp/scratch")) > 1, "open \"/tmp/scratch\"");
+  CHECK((copy_fd = open("/copy")) > 1, "open \"/copy\"");
+  CHECK(copy_file_range(fd, copy_fd, sizeof buf) == sizeof buf,
+        "copy \"/tmp/scratch\" to \"/copy\"");
+  msg("close \"/tmp/scratch\"");
+  close(fd);
+  msg("close \"/copy\"");
+  close(copy_fd);
+  check_file("/copy", buf, sizeof buf);
+
+  CHECK(remove("/tmp/scratch"), "remove \"/tmp/scratch\"");
+  CHECK(remove("/tmp/sub"), "remove \"/tmp/sub\"");
+}
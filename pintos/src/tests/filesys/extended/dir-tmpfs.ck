@@ -0,0 +1,36 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-tmpfs) begin
+(dir-tmpfs) create "/tmp/scratch"
+(dir-tmpfs) open "/tmp/scratch"
+(dir-tmpfs) write "/tmp/scratch"
+(dir-tmpfs) close "/tmp/scratch"
+(dir-tmpfs) open "/tmp/scratch" for verification
+(dir-tmpfs) verified contents of "/tmp/scratch"
+(dir-tmpfs) close "/tmp/scratch"
+(dir-tmpfs) mkdir "/tmp/sub"
+(dir-tmpfs) chdir "/tmp/sub"
+(dir-tmpfs) open "../.."
+(dir-tmpfs) open "/"
+(dir-tmpfs) "../.." is "/"
+(dir-tmpfs) close "../.."
+(dir-tmpfs) close "/"
+(dir-tmpfs) chdir "/"
+(dir-tmpfs) remove "/tmp" (must fail)
+(dir-tmpfs) create "/copy"
+(dir-tmpfs) open "/tmp/scratch"
+(dir-tmpfs) open "/copy"
+(dir-tmpfs) copy "/tmp/scratch" to "/copy"
+(dir-tmpfs) close "/tmp/scratch"
+(dir-tmpfs) close "/copy"
+(dir-tmpfs) open "/copy" for verification
+(dir-tmpfs) verified contents of "/copy"
+(dir-tmpfs) close "/copy"
+(dir-tmpfs) remove "/tmp/scratch"
+(dir-tmpfs) remove "/tmp/sub"
+(dir-tmpfs) end
+EOF
+pass;
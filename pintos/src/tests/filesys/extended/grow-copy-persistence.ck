@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = "a" x 1000 . "\0" x 4000 . "b" x 1000;
+check_archive ({"testfile" => [$data], "copy" => [$data]});
+pass;
@@ -0,0 +1,42 @@
+/* Creates a sparse file, copies it to a new file with
+   copy_file_range(), and checks that the copy matches. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[6000];
+
+void test_main(void) {
+  const char* src_name = "testfile";
+  const char* dst_name = "copy";
+  int src_fd, dst_fd;
+
+  memset(buf, 'a', 1000);
+  memset(buf + 5000, 'b', 1000);
+
+  CHECK(create(src_name, 0), "create \"%s\"", src_name);
+  CHECK((src_fd = open(src_name)) > 1, "open \"%s\"", src_name);
+  CHECK(write(src_fd, buf, 1000) == 1000, "write \"%s\"", src_name);
+  msg("seek \"%s\"", src_name);
+  seek(src_fd, 5000);
+  CHECK(write(src_fd, buf + 5000, 1000) == 1000, "write \"%s\"", src_name);
+
+  CHECK(create(dst_name, 0), "create \"%s\"", dst_name);
+  CHECK((dst_fd = open(dst_name)) > 1, "open \"%s\"", dst_name);
+  msg("seek \"%s\"", src_name);
+  seek(src_fd, 0);
+  CHECK(copy_file_range(src_fd, dst_fd, 10000) == sizeof buf, "copy \"%s\" to \"%s\"", src_name,
+        dst_name);
+  CHECK(tell(src_fd) == sizeof buf, "tell \"%s\"", src_name);
+  CHECK(tell(dst_fd) == sizeof buf, "tell \"%s\"", dst_name);
+  CHECK(copy_file_range(src_fd, dst_fd, 10000) == 0, "copy at end of \"%s\"", src_name);
+  CHECK(filesize(dst_fd) == sizeof buf, "filesize \"%s\"", dst_name);
+  msg("close \"%s\"", src_name);
+  close(src_fd);
+  msg("close \"%s\"", dst_name);
+  close(dst_fd);
+
+  check_file(dst_name, buf, sizeof buf);
+}
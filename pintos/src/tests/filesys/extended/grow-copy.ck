@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-copy) begin
+(grow-copy) create "testfile"
+(grow-copy) open "testfile"
+(grow-copy) write "testfile"
+(grow-copy) seek "testfile"
+(grow-copy) write "testfile"
+(grow-copy) create "copy"
+(grow-copy) open "copy"
+(grow-copy) seek "testfile"
+(grow-copy) copy "testfile" to "copy"
+(grow-copy) tell "testfile"
+(grow-copy) tell "copy"
+(grow-copy) copy at end of "testfile"
+(grow-copy) filesize "copy"
+(grow-copy) close "testfile"
+(grow-copy) close "copy"
+(grow-copy) open "copy" for verification
+(grow-copy) verified contents of "copy"
+(grow-copy) close "copy"
+(grow-copy) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Grows two files in alternating sectors, so that they are
+   likely to interleave on disk, then makes one of them
+   contiguous with defrag() and checks that both still read
+   back correctly. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SECTOR_CNT 40
+
+static char buf_a[SECTOR_CNT * 512];
+static char buf_b[SECTOR_CNT * 512];
+
+void test_main(void) {
+  struct fsstat stats;
+  int fd_a, fd_b, i;
+
+  random_init(0);
+  random_bytes(buf_a, sizeof buf_a);
+  random_bytes(buf_b, sizeof buf_b);
+
+  CHECK(create("a", 0), "create \"a\"");
+  CHECK(create("b", 0), "create \"b\"");
+  CHECK((fd_a = open("a")) > 1, "open \"a\"");
+  CHECK((fd_b = open("b")) > 1, "open \"b\"");
+  msg("write \"a\" and \"b\" in alternating sectors");
+  for (i = 0; i < SECTOR_CNT; i++) {
+    if (write(fd_a, buf_a + i * 512, 512) != 512)
+      fail("write \"a\" failed");
+    if (write(fd_b, buf_b + i * 512, 512) != 512)
+      fail("write \"b\" failed");
+  }
+  msg("close \"a\"");
+  close(fd_a);
+  msg("close \"b\"");
+  close(fd_b);
+
+  CHECK((fd_a = open("a")) > 1, "open \"a\"");
+  CHECK(fragments(fd_a) >= 1, "fragments \"a\"");
+  CHECK(defrag(fd_a) == 1, "defrag \"a\"");
+  CHECK(fsstat(&stats), "fsstat");
+  CHECK(stats.free_sectors > 0 && stats.largest_extent <= stats.free_sectors,
+        "free space is consistent");
+  msg("close \"a\"");
+  close(fd_a);
+
+  check_file("a", buf_a, sizeof buf_a);
+  check_file("b", buf_b, sizeof buf_b);
+}
@@ -0,0 +1,31 @@
+/* Preallocates space for a file, checks that it reads as zeros
+   and is contiguous, then writes into the middle of it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[10000];
+
+void test_main(void) {
+  const char* file_name = "testfile";
+  int fd;
+
+  CHECK(create(file_name, 0), "create \"%s\"", file_name);
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  CHECK(fallocate(fd, 0, sizeof buf) == 1, "fallocate \"%s\"", file_name);
+  CHECK(filesize(fd) == sizeof buf, "filesize \"%s\"", file_name);
+  msg("close \"%s\"", file_name);
+  close(fd);
+  check_file(file_name, buf, sizeof buf);
+
+  memset(buf + 1000, 'x', 3000);
+  CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+  msg("seek \"%s\"", file_name);
+  seek(fd, 1000);
+  CHECK(write(fd, buf + 1000, 3000) == 3000, "write \"%s\"", file_name);
+  msg("close \"%s\"", file_name);
+  close(fd);
+  check_file(file_name, buf, sizeof buf);
+}
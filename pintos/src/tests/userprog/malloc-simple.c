@@ -0,0 +1,58 @@
+/* Allocates, fills, resizes and frees blocks of many sizes from
+   the user heap, checking that live blocks keep their contents
+   and that freed memory is reused. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64
+
+static char* blocks[BLOCK_CNT];
+
+static size_t block_size(int i) { return (size_t)(i * 97 % 5000) + 1; }
+
+void test_main(void) {
+  void* brk;
+  char* p;
+  int i;
+
+  for (i = 0; i < BLOCK_CNT; i++) {
+    blocks[i] = malloc(block_size(i));
+    if (blocks[i] == NULL)
+      fail("malloc %zu bytes failed", block_size(i));
+    memset(blocks[i], i, block_size(i));
+  }
+  brk = sbrk(0);
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free(blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2) {
+    size_t j;
+    for (j = 0; j < block_size(i); j++)
+      if (blocks[i][j] != (char)i)
+        fail("block %d corrupted at byte %zu", i, j);
+  }
+  msg("live blocks intact");
+
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    blocks[i] = malloc(block_size(i));
+  if ((char*)sbrk(0) > (char*)brk)
+    fail("freed blocks not reused");
+  msg("freed blocks reused");
+
+  p = realloc(blocks[1], 3 * block_size(1));
+  CHECK(p != NULL && p[0] == 1, "realloc keeps contents");
+  blocks[1] = p;
+
+  p = calloc(100, 10);
+  for (i = 0; i < 1000; i++)
+    if (p[i] != 0)
+      fail("calloc returned nonzero byte at %d", i);
+  msg("calloc zeroes memory");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    free(blocks[i]);
+  free(p);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-simple) begin
+(malloc-simple) live blocks intact
+(malloc-simple) freed blocks reused
+(malloc-simple) realloc keeps contents
+(malloc-simple) calloc zeroes memory
+(malloc-simple) end
+malloc-simple: exit(0)
+EOF
+pass;
@@ -39,6 +39,12 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/tmpfs.h"
+#endif
+#ifdef VM
+#include "vm/page.h"
+#include "vm/share.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -52,6 +58,10 @@ static bool format_filesys;
    overriding the defaults. */
 static const char* filesys_bdev_name;
 static const char* scratch_bdev_name;
+
+/* -tmpfs: Pages of memory for a tmpfs mounted on /tmp, or 0 to
+   mount none. */
+static size_t tmpfs_page_limit;
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
@@ -60,6 +70,11 @@ static const char* swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -zswap: Pages of memory to spend on compressed swap. */
+static size_t zswap_page_limit = 64;
+#endif
+
 static void bss_init(void);
 static void paging_init(void);
 
@@ -123,11 +138,24 @@ int main(void) {
   userprog_init();
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  share_init();
+  page_init();
+#endif
+
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init();
   locate_block_devices();
   filesys_init(format_filesys);
+  if (tmpfs_page_limit > 0 && !tmpfs_mount("/tmp", tmpfs_page_limit))
+    PANIC("mounting tmpfs on /tmp failed");
+#endif
+
+#ifdef VM
+  /* Initialize swap. */
+  swap_init(zswap_page_limit);
 #endif
 
   printf("Boot complete.\n");
@@ -240,9 +268,13 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-tmpfs"))
+      tmpfs_page_limit = atoi(value);
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
+    else if (!strcmp(name, "-zswap"))
+      zswap_page_limit = atoi(value);
 #endif
 #endif
     else if (!strcmp(name, "-rs"))
@@ -364,6 +396,8 @@ static void run_actions(char** argv) {
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"frag", 1, fsutil_frag},
+      {"defrag", 1, fsutil_defrag},
 #endif
       {NULL, 0, NULL},
   };
@@ -408,6 +442,8 @@ static void usage(void) {
          "  ls                 List files in the root directory.\n"
          "  cat FILE           Print FILE to the console.\n"
          "  rm FILE            Delete FILE.\n"
+         "  frag               Report fragmentation of files and free space.\n"
+         "  defrag             Make each file contiguous, where there is room.\n"
          "Use these actions indirectly via `pintos' -g and -p options:\n"
          "  extract            Untar from scratch device into file system.\n"
          "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -420,8 +456,10 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -tmpfs=PAGES       Mount a tmpfs of up to PAGES pages of RAM on /tmp.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+         "  -zswap=PAGES       Keep up to PAGES pages of compressed swap in RAM.\n"
 #endif // VM
 #endif // FILESYS
          "  -rs=SEED           Set random number seed to SEED.\n"
@@ -50,6 +50,12 @@ struct thread {
   int nice;
   fixed_point_t recent_cpu;
 
+#ifdef FILESYS
+  /* Owned by filesys/log.c. */
+  int log_depth;  /* Nesting depth of journal operations. */
+  int log_blocks; /* Sectors the operation added to the journal. */
+#endif
+
 #ifdef USERPROG
   /* Owned by process.c. */
   struct process* pcb; /* Process control block if this thread is a userprog */
@@ -6,6 +6,9 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -136,6 +139,16 @@ static void page_fault(struct intr_frame* f) {
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Faults on pages the process owns that are not resident:
+     untouched heap or executable pages and evicted pages, and
+     writes to pages still mapped to the zero frame, whether from
+     user code or from a system call copying to or from user
+     memory. */
+  if ((not_present || write) && page_fault_in(fault_addr, write))
+    return;
+#endif
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
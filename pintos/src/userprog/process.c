@@ -19,6 +19,10 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#include "vm/share.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static thread_func start_pthread NO_RETURN;
@@ -27,7 +31,6 @@ bool setup_thread(void** esp);
 
 static struct list thread_block_list;
 static struct lock prog_lock;
-static struct lock file_lock;
 
 static void args_push_stack(const char* file_name, void** if_esp) {
   void* esp = *if_esp;
@@ -161,6 +164,10 @@ int file_to_fd(struct file* file) {
   return e->fd;
 }
 
+/* Returns the file open as FD in the current process, or a null
+   pointer if there is none.  The file is held, so that it stays
+   open even if another thread closes FD, and the caller must
+   close it when done. */
 struct file* fd_to_file(int fd) {
   struct process* pcb = thread_current()->pcb;
   if (pcb == NULL)
@@ -171,7 +178,7 @@ struct file* fd_to_file(int fd) {
   for (e = list_begin(&pcb->all_files_list); e != list_end(&pcb->all_files_list); e = list_next(e)) {
     struct file_list_elem* file_list_elem = list_entry(e, struct file_list_elem, elem);
     if (file_list_elem->fd == fd) {
-      file = file_list_elem->file;
+      file = file_hold(file_list_elem->file);
       break;
     }
   }
@@ -180,9 +187,7 @@ struct file* fd_to_file(int fd) {
 }
 
 int open_for_syscall(const char* file) {
-  lock_acquire(&file_lock);
   struct file* opened_file = filesys_open(file);
-  lock_release(&file_lock);
   if (opened_file == NULL)
     return -1;
   return file_to_fd(opened_file);
@@ -209,9 +214,7 @@ bool close_file(int fd) {
 
   if (!success)
     return false;
-  lock_acquire(&file_lock);
   file_close(file);
-  lock_release(&file_lock);
   return success;
 }
 
@@ -299,7 +302,6 @@ void userprog_init(void) {
   t->pcb = calloc(sizeof(struct process), 1);
   success = t->pcb != NULL;
 
-  lock_init(&file_lock);
   lock_init(&prog_lock);
   list_init(&thread_block_list);
 
@@ -330,6 +332,11 @@ pid_t process_execute(const char* file_name) {
     thread_block->pid = thread_current()->tid;
   else thread_block->pid = thread_current()->pcb->main_thread->tid;
   thread_block->load_success = false;
+  /* The child starts out in the parent's working directory. */
+  if (thread_current()->pcb != NULL && thread_current()->pcb->cwd != NULL)
+    thread_block->cwd = dir_reopen(thread_current()->pcb->cwd);
+  else
+    thread_block->cwd = dir_open_root();
   sema_init(&thread_block->semapth, 0);
   sema_init(&thread_block->load_semapth, 0);
   lock_acquire(&prog_lock);
@@ -339,8 +346,10 @@ pid_t process_execute(const char* file_name) {
   /* Create a new thread to execute FILE_NAME. */
   tid= thread_create(file_name, PRI_DEFAULT, start_process, fn_copy);
   thread_block->tid = tid;
-  if (tid == TID_ERROR)
+  if (tid == TID_ERROR) {
     palloc_free_page(fn_copy);
+    dir_close(thread_block->cwd);
+  }
 
   sema_down(&thread_block->load_semapth);
   if (!thread_block->load_success)
@@ -379,12 +388,24 @@ static void start_process(void* file_name_) {
     list_init(&new_pcb->prog_sema_list);
     new_pcb->next_lock_id = 1;
     new_pcb->next_sema_id = 1;
+    new_pcb->heap_start = new_pcb->heap_end = NULL;
+    lock_init(&new_pcb->heap_lock);
+#ifdef VM
+    list_init(&new_pcb->shared_pages);
+    page_table_init(new_pcb);
+#endif
 
     // Continue initializing the PCB as normal
     new_pcb->main_thread = t;
     strlcpy(new_pcb->process_name, argv, sizeof(new_pcb->process_name));
   }
   block = get_thread_block(t->tid);
+  if (success)
+    new_pcb->cwd = block->cwd;
+  else
+    dir_close(block->cwd);
+  block->cwd = NULL;
+
   /* Initialize interrupt frame and load executable. */
   if (success) {
     memset(&if_, 0, sizeof if_);
@@ -401,6 +422,7 @@ static void start_process(void* file_name_) {
     // can try to activate the pagedir, but it is now freed memory
     struct process* pcb_to_free = t->pcb;
     t->pcb = NULL;
+    dir_close(pcb_to_free->cwd);
     free(pcb_to_free);
   }
 
@@ -483,7 +505,6 @@ void process_exit(void) {
     struct prog_sema_block* block = list_entry(e, struct prog_sema_block, elem);
     free(block);
   }
-  lock_acquire(&file_lock);
   lock_acquire(&pcb->file_list_lock);
   while (!list_empty(&pcb->all_files_list)) {
     struct list_elem* e = list_pop_back(&pcb->all_files_list);
@@ -492,6 +513,8 @@ void process_exit(void) {
     free(file_list_elem);
   }
   lock_release(&pcb->file_list_lock);
+  dir_close(pcb->cwd);
+  pcb->cwd = NULL;
   enum intr_level old_level = intr_disable();
   // 关闭所有子线程
   struct list* all_threads = &pcb->all_threads;
@@ -524,7 +547,14 @@ void process_exit(void) {
 
   file_close(cur->pcb->file);
   intr_set_level(old_level);
-  lock_release(&file_lock);
+
+#ifdef VM
+  /* Drop shared text pages and private pages before
+     pagedir_destroy() frees their frames.  This takes vm_lock and
+     may wait for swap, so it runs with interrupts on. */
+  share_unmap_all();
+  page_table_destroy(cur->pcb);
+#endif
 
   if (pd != NULL) {
     /* Correct ordering here is crucial.  We must set
@@ -713,12 +743,17 @@ bool load(const char* file_name, void (**eip)(void), void** esp) {
           }
           if (!load_segment(file, file_page, (void*)mem_page, read_bytes, zero_bytes, writable))
             goto done;
+          if ((uint8_t*)mem_page + read_bytes + zero_bytes > t->pcb->heap_start)
+            t->pcb->heap_start = (uint8_t*)mem_page + read_bytes + zero_bytes;
         } else
           goto done;
         break;
     }
   }
 
+  /* The heap starts out empty, just above the highest segment. */
+  t->pcb->heap_end = t->pcb->heap_start;
+
   /* Set up stack. */
   if (!setup_stack(esp))
     goto done;
@@ -730,19 +765,25 @@ bool load(const char* file_name, void (**eip)(void), void** esp) {
 
 done:
   /* We arrive here whether the load is successful or not. */
-  lock_acquire(&file_lock);
   if (success) {
     file_deny_write(file);
     t->pcb->file = file;
   } 
-  else file_close(file);
-  lock_release(&file_lock);
+  else {
+#ifdef VM
+    share_unmap_all();
+    page_table_destroy(t->pcb);
+#endif
+    file_close(file);
+  }
   return success;
 }
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page(void* upage, void* kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -807,6 +848,10 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
   ASSERT(pg_ofs(upage) == 0);
   ASSERT(ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Pages are read in as they are touched, by page_fault_in(). */
+  return page_map_file(file, ofs, upage, read_bytes, zero_bytes, writable);
+#else
   file_seek(file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) {
     /* Calculate how to fill this page.
@@ -839,6 +884,7 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
     upage += PGSIZE;
   }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -847,6 +893,14 @@ static bool setup_stack(void** esp) {
   uint8_t* kpage;
   bool success = false;
 
+#ifdef VM
+  kpage = page_alloc(((uint8_t*)PHYS_BASE) - PGSIZE, true);
+  if (kpage != NULL) {
+    page_unpin(((uint8_t*)PHYS_BASE) - PGSIZE);
+    *esp = PHYS_BASE;
+    success = true;
+  }
+#else
   kpage = palloc_get_page(PAL_USER | PAL_ZERO);
   if (kpage != NULL) {
     success = install_page(((uint8_t*)PHYS_BASE) - PGSIZE, kpage, true);
@@ -855,9 +909,11 @@ static bool setup_stack(void** esp) {
     else
       palloc_free_page(kpage);
   }
+#endif
   return success;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -875,6 +931,75 @@ static bool install_page(void* upage, void* kpage, bool writable) {
   return (pagedir_get_page(t->pcb->pagedir, upage) == NULL &&
           pagedir_set_page(t->pcb->pagedir, upage, kpage, writable));
 }
+#endif
+
+/* Unmaps and frees the heap pages of the current process that
+   lie entirely within [START, END). */
+static void heap_free_pages(uint8_t* start, uint8_t* end) {
+  uint8_t* upage;
+
+  for (upage = (uint8_t*)ROUND_UP((uintptr_t)start, PGSIZE); upage < end; upage += PGSIZE) {
+#ifdef VM
+    page_free(upage);
+#else
+    uint32_t* pd = thread_current()->pcb->pagedir;
+    void* kpage = pagedir_get_page(pd, upage);
+    if (kpage != NULL) {
+      pagedir_clear_page(pd, upage);
+      palloc_free_page(kpage);
+    }
+#endif
+  }
+}
+
+/* Maps zeroed pages covering [START, END) in the current process,
+   past those already mapped below START.  Returns true if
+   successful, false if memory runs out, in which case no new
+   pages remain mapped.  With VM, heap pages are instead
+   zero-filled on first touch by page_fault_in(). */
+static bool heap_alloc_pages(uint8_t* start UNUSED, uint8_t* end UNUSED) {
+#ifndef VM
+  uint8_t* upage;
+
+  for (upage = (uint8_t*)ROUND_UP((uintptr_t)start, PGSIZE); upage < end; upage += PGSIZE) {
+    uint8_t* kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+    if (kpage == NULL || !install_page(upage, kpage, true)) {
+      palloc_free_page(kpage);
+      heap_free_pages(start, upage);
+      return false;
+    }
+  }
+#endif
+  return true;
+}
+
+/* Moves the current process's break INCREMENT bytes up (or down,
+   if negative) and returns the previous break.  The heap lies
+   between the end of the loaded segments and the region reserved
+   for thread stacks.  Returns (void*)-1 without changing the
+   break if it would leave that range or memory runs out. */
+void* process_sbrk(intptr_t increment) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* heap_limit = (uint8_t*)PHYS_BASE - MAX_STACK_PAGES * PGSIZE;
+  uint8_t *old_end, *new_end;
+
+  lock_acquire(&pcb->heap_lock);
+  old_end = pcb->heap_end;
+  new_end = old_end + increment;
+  if (increment > 0) {
+    if (new_end > heap_limit || new_end < old_end || !heap_alloc_pages(old_end, new_end))
+      old_end = (void*)-1;
+  } else if (increment < 0) {
+    if (new_end < pcb->heap_start || new_end > old_end)
+      old_end = (void*)-1;
+    else
+      heap_free_pages(new_end, old_end);
+  }
+  if (old_end != (void*)-1)
+    pcb->heap_end = new_end;
+  lock_release(&pcb->heap_lock);
+  return old_end;
+}
 
 /* Returns true if t is the main thread of the process p */
 bool is_main_thread(struct thread* t, struct process* p) { return p->main_thread == t; }
@@ -893,8 +1018,38 @@ pid_t get_pid(struct process* p) { return (pid_t)p->main_thread->tid; }
 bool setup_thread(void** esp) {
   uint8_t* kpage;
   bool success = false;
-  enum intr_level old_level = intr_disable();
   struct thread* cur = thread_current();
+#ifdef VM
+  /* Stack pages may be swapped out, so look for a free slot in
+     the page table rather than the page directory.  Allocating
+     takes vm_lock and may wait for swap, so interrupts stay on;
+     page_alloc() fails if another thread takes the slot first,
+     and then the next free one is tried. */
+  if (cur->pcb != NULL && cur->pcb->pagedir != NULL) {
+    void* base = PHYS_BASE;
+    int max_pthread_num = 1000000;
+    for (int i = 0; i < max_pthread_num; i++) {
+      uint8_t* upage;
+
+      base -= PGSIZE;
+      upage = (uint8_t*)base - PGSIZE;
+      if (page_exists(upage))
+        continue;
+      kpage = page_alloc(upage, true);
+      if (kpage != NULL) {
+        page_unpin(upage);
+        cur->upage = upage;
+        *esp = base;
+        success = true;
+        break;
+      }
+      if (!page_exists(upage))
+        break;
+    }
+  }
+  return success;
+#else
+  enum intr_level old_level = intr_disable();
   if (cur->pcb != NULL && cur->pcb->pagedir != NULL) {
     kpage = palloc_get_page(PAL_USER | PAL_ZERO);
     if (kpage != NULL) {
@@ -916,6 +1071,7 @@ bool setup_thread(void** esp) {
   }
   intr_set_level(old_level);
   return success;
+#endif
 }
 /* Starts a new thread with a new user stack running SF, which takes
    TF and ARG as arguments on its user stack. This new thread may be
@@ -1049,10 +1205,14 @@ void pthread_exit(void) {
     list_remove(&cur->p_elem);
   if (cur->pcb->pagedir != NULL) {
     void* upage = cur->upage;
+#ifdef VM
+    page_free(upage);
+#else
     uint8_t* kpage = pagedir_get_page(cur->pcb->pagedir, upage);
     if (kpage != NULL)
       palloc_free_page(kpage);
     pagedir_clear_page(cur->pcb->pagedir, upage);
+#endif
   }
   thread_exit();
 }
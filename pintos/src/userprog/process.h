@@ -2,6 +2,7 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include <hash.h>
 #include <stdint.h>
 
 #include "filesys/filesys.h"
@@ -53,6 +54,7 @@ struct thread_block {
   struct semaphore semapth;
   struct semaphore load_semapth;
   bool load_success;
+  struct dir* cwd; /* Working directory for a new process. */
 };
 
 
@@ -77,6 +79,16 @@ struct process {
   struct file* file;
   int next_lock_id;
   struct list prog_sema_list;
+  struct dir* cwd;            /* Working directory, or NULL for root. */
+  uint8_t* heap_start;        /* First page above the loaded segments. */
+  uint8_t* heap_end;          /* Current break, moved by sbrk(). */
+  struct lock heap_lock;      /* Serializes changes to the break and,
+                                 with VM, page faults. */
+#ifdef VM
+  struct list shared_pages; /* Read-only pages mapped from vm/share.c. */
+  struct hash pages;        /* Private pages, managed by vm/page.c. */
+  struct list file_maps;    /* Demand-paged file regions, ditto. */
+#endif
 
 };
 
@@ -95,6 +107,8 @@ tid_t pthread_join(tid_t);
 void pthread_exit(void);
 void pthread_exit_main(void);
 
+void* process_sbrk(intptr_t increment);
+
 void set_exit_code(struct thread* t, int code);
 int file_to_fd(struct file* file);
 struct file* fd_to_file(int fd);
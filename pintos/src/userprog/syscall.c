@@ -1,5 +1,7 @@
 #include "userprog/syscall.h"
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -8,21 +10,59 @@
 #include "filesys/filesys.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
 #include "pagedir.h"
 #include "stddef.h"
 #include <float.h>
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 static void syscall_handler(struct intr_frame*);
 
 void syscall_init(void) { intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall"); }
 
+/* Returns true if user address ADDR is backed by a page,
+   faulting it in first if the process owns it but has not
+   touched it yet or it was evicted. */
+static bool is_mapped(void* addr) {
+  if (pagedir_get_page(thread_current()->pcb->pagedir, addr) != NULL)
+    return true;
+#ifdef VM
+  return page_fault_in(addr, false);
+#else
+  return false;
+#endif
+}
+
 bool check_valid_addr(struct intr_frame* f, void* addr) {
-  if (!is_user_vaddr(addr) || pagedir_get_page(thread_current()->pcb->pagedir, addr) == NULL) {
+  if (!is_user_vaddr(addr) || !is_mapped(addr)) {
+    syscall_exit(f, -1);
+    return false;
+  }
+  return true;
+}
+
+/* Checks every page of the SIZE bytes at BUFFER as
+   check_valid_addr() does. */
+static bool check_valid_range(struct intr_frame* f, void* buffer, size_t size) {
+  uint8_t* start = buffer;
+  uint8_t* end = start + size;
+  uint8_t* upage;
+
+  if (size == 0)
+    return true;
+  if (end < start) {
     syscall_exit(f, -1);
     return false;
   }
+  for (upage = pg_round_down(start); upage < end; upage += PGSIZE)
+    if (!check_valid_addr(f, upage < start ? start : upage))
+      return false;
   return true;
 }
 
@@ -75,16 +115,12 @@ int syscall_read(int fd, void* buffer, unsigned size) {
     }
     return size;
   }
-  struct process* pcb = thread_current()->pcb;
-  if (pcb == NULL)
-    return -1;
   struct file* file = fd_to_file(fd);
-  if (file == NULL)
-    return -1;
-  lock_acquire(&pcb->file_list_lock);
-  int flag = file_read(file, buffer, size);
-  lock_release(&pcb->file_list_lock);
-  return flag;
+  int bytes_read = -1;
+  if (file != NULL && !inode_is_dir(file_get_inode(file)))
+    bytes_read = file_read(file, buffer, size);
+  file_close(file);
+  return bytes_read;
 }
 
 int syscall_write(int fd, const void* buffer, unsigned size) {
@@ -94,15 +130,11 @@ int syscall_write(int fd, const void* buffer, unsigned size) {
   }
 
   struct file* file = fd_to_file(fd);
-  if (file == NULL)
-    return -1;
-  struct process* pcb = thread_current()->pcb;
-  if (pcb == NULL)
-    return -1;
-  lock_acquire(&pcb->file_list_lock);
-  int write_size = file_write(file, buffer, size);
-  lock_release(&pcb->file_list_lock);
-  return write_size;
+  int bytes_written = -1;
+  if (file != NULL && !inode_is_dir(file_get_inode(file)))
+    bytes_written = file_write(file, buffer, size);
+  file_close(file);
+  return bytes_written;
 }
 
 void syscall_file_size(struct intr_frame* f, int fd) {
@@ -112,6 +144,7 @@ void syscall_file_size(struct intr_frame* f, int fd) {
     return;
   }
   f->eax = file_length(file);
+  file_close(file);
 }
 
 void syscall_seek(struct intr_frame* f, int fd, unsigned position) {
@@ -121,6 +154,7 @@ void syscall_seek(struct intr_frame* f, int fd, unsigned position) {
     return;
   }
   file_seek(file, position);
+  file_close(file);
 }
 
 void syscall_tell(struct intr_frame* f, int fd) {
@@ -130,6 +164,180 @@ void syscall_tell(struct intr_frame* f, int fd) {
     return;
   }
   f->eax = file_tell(file);
+  file_close(file);
+}
+
+static void syscall_sbrk(struct intr_frame* f, intptr_t increment) {
+  f->eax = (uint32_t)process_sbrk(increment);
+}
+
+/* Changes the working directory to DIR. */
+static void syscall_chdir(struct intr_frame* f, const char* dir) {
+  struct process* pcb = thread_current()->pcb;
+  struct dir* new_cwd;
+
+  if (!check_valid_addr(f, dir))
+    return;
+  new_cwd = filesys_open_dir(dir);
+  if (new_cwd == NULL) {
+    f->eax = false;
+    return;
+  }
+  dir_close(pcb->cwd);
+  pcb->cwd = new_cwd;
+  f->eax = true;
+}
+
+static void syscall_mkdir(struct intr_frame* f, const char* dir) {
+  if (!check_valid_addr(f, dir))
+    return;
+  f->eax = filesys_mkdir(dir);
+}
+
+/* Reads the next entry of directory FD into NAME.  The file's
+   position counts the entries read so far. */
+static void syscall_readdir(struct intr_frame* f, int fd, char* name) {
+  struct file* file;
+  struct dir* dir;
+
+  if (!check_valid_range(f, name, NAME_MAX + 1))
+    return;
+#ifdef VM
+  /* Pin NAME, since the entry is copied into it while holding
+     locks the page fault handler may need. */
+  if (!page_pin_user(name, NAME_MAX + 1, true)) {
+    syscall_exit(f, -1);
+    return;
+  }
+#endif
+  file = fd_to_file(fd);
+  if (file == NULL || !inode_is_dir(file_get_inode(file)) ||
+      (dir = dir_open(inode_reopen(file_get_inode(file)))) == NULL)
+    f->eax = false;
+  else {
+    dir_seek(dir, file_tell(file));
+    f->eax = dir_readdir(dir, name);
+    file_seek(file, dir_tell(dir));
+    dir_close(dir);
+  }
+  file_close(file);
+#ifdef VM
+  page_unpin_user(name, NAME_MAX + 1);
+#endif
+}
+
+static void syscall_isdir(struct intr_frame* f, int fd) {
+  struct file* file = fd_to_file(fd);
+  f->eax = file != NULL && inode_is_dir(file_get_inode(file));
+  file_close(file);
+}
+
+static void syscall_inumber(struct intr_frame* f, int fd) {
+  struct file* file = fd_to_file(fd);
+  f->eax = file != NULL ? (int)inode_get_inumber(file_get_inode(file)) : -1;
+  file_close(file);
+}
+
+/* Preallocates LENGTH bytes of FD at OFFSET.  Returns 1 if they
+   are contiguous on disk, 0 if not, or -1 on failure. */
+static void syscall_fallocate(struct intr_frame* f, int fd, off_t offset, off_t length) {
+  struct file* file = fd_to_file(fd);
+  bool contiguous;
+
+  if (file == NULL || inode_is_dir(file_get_inode(file)) || offset < 0 || length < 0 ||
+      !file_allocate(file, offset, length, &contiguous))
+    f->eax = -1;
+  else
+    f->eax = contiguous;
+  file_close(file);
+}
+
+/* Copies SIZE bytes from file IN_FD to file OUT_FD, from and to
+   their current positions, within the kernel. */
+static void syscall_copy_file_range(struct intr_frame* f, int in_fd, int out_fd, unsigned size) {
+  struct file* in = fd_to_file(in_fd);
+  struct file* out = fd_to_file(out_fd);
+
+  if (in == NULL || out == NULL || inode_is_dir(file_get_inode(in)) ||
+      inode_is_dir(file_get_inode(out)))
+    f->eax = -1;
+  else
+    f->eax = file_copy(in, out, size < INT32_MAX ? size : INT32_MAX);
+  file_close(in);
+  file_close(out);
+}
+
+/* Stores a summary of free space into *USTATS.  The summary is
+   gathered in kernel memory, under the free map's lock, and only
+   then copied out. */
+static void syscall_fsstat(struct intr_frame* f, struct fsstat* ustats) {
+  struct fsstat stats;
+
+  if (!check_valid_range(f, ustats, sizeof *ustats))
+    return;
+  free_map_stats(&stats);
+#ifdef VM
+  if (!page_pin_user(ustats, sizeof *ustats, true)) {
+    syscall_exit(f, -1);
+    return;
+  }
+#endif
+  memcpy(ustats, &stats, sizeof stats);
+#ifdef VM
+  page_unpin_user(ustats, sizeof *ustats);
+#endif
+  f->eax = true;
+}
+
+static void syscall_fragments(struct intr_frame* f, int fd) {
+  struct file* file = fd_to_file(fd);
+  f->eax = file != NULL ? inode_fragments(file_get_inode(file)) : -1;
+  file_close(file);
+}
+
+/* Moves file FD into a single run of sectors and returns its
+   number of fragments afterward, or -1 if there is no room. */
+static void syscall_defrag(struct intr_frame* f, int fd) {
+  struct file* file = fd_to_file(fd);
+
+  if (file == NULL || !inode_defragment(file_get_inode(file)))
+    f->eax = -1;
+  else
+    f->eax = inode_fragments(file_get_inode(file));
+  file_close(file);
+}
+
+/* Stores as many entries of directory FD as fit in the SIZE bytes
+   at BUFFER.  The file's position is the cookie from which the
+   next call resumes. */
+static void syscall_getdents(struct intr_frame* f, int fd, void* buffer, unsigned size) {
+  struct file* file;
+  struct dir* dir;
+
+  if (!check_valid_range(f, buffer, size))
+    return;
+#ifdef VM
+  /* Pin the buffer, since the directory is read into it while
+     holding locks the page fault handler may need. */
+  if (!page_pin_user(buffer, size, true)) {
+    syscall_exit(f, -1);
+    return;
+  }
+#endif
+  file = fd_to_file(fd);
+  if (file == NULL || !inode_is_dir(file_get_inode(file)) ||
+      (dir = dir_open(inode_reopen(file_get_inode(file)))) == NULL)
+    f->eax = -1;
+  else {
+    dir_seek(dir, file_tell(file));
+    f->eax = dir_getdents(dir, buffer, size);
+    file_seek(file, dir_tell(dir));
+    dir_close(dir);
+  }
+  file_close(file);
+#ifdef VM
+  page_unpin_user(buffer, size);
+#endif
 }
 
 static void syscall_handler(struct intr_frame* f UNUSED) {
@@ -170,12 +378,32 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     case SYS_READ:
       if (!check_valid_addr(f, (char*)args[2]) || !check_valid_addr(f, (char*)(args + 0x10)) || !check_valid_addr(f, (char*)(args + 0x0c)) || !check_valid_addr(f, (char*)(args + 0x08)))
         return;
+#ifdef VM
+      /* Pin the buffer, since the file system reads into it
+         while holding locks the page fault handler may need. */
+      if (!page_pin_user((void*)args[2], args[3], true)) {
+        syscall_exit(f, -1);
+        return;
+      }
       f->eax = syscall_read(args[1], (char*)args[2], args[3]);
+      page_unpin_user((void*)args[2], args[3]);
+#else
+      f->eax = syscall_read(args[1], (char*)args[2], args[3]);
+#endif
       break;
     case SYS_WRITE:
       if (!check_valid_addr(f, (char*)args[2]))
         return;
+#ifdef VM
+      if (!page_pin_user((void*)args[2], args[3], false)) {
+        syscall_exit(f, -1);
+        return;
+      }
+      f->eax = syscall_write(args[1], (char*)args[2], args[3]);
+      page_unpin_user((void*)args[2], args[3]);
+#else
       f->eax = syscall_write(args[1], (char*)args[2], args[3]);
+#endif
       break;
     case SYS_FILESIZE: 
       if (!check_valid_addr(f, (char*)(args + 0x08)))
@@ -229,6 +457,50 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     case SYS_GET_TID:
       f->eax = thread_current()->tid;
       break;
+    case SYS_SBRK:
+      syscall_sbrk(f, (intptr_t)args[1]);
+      break;
+    case SYS_CHDIR:
+      syscall_chdir(f, (char*)args[1]);
+      break;
+    case SYS_MKDIR:
+      syscall_mkdir(f, (char*)args[1]);
+      break;
+    case SYS_READDIR:
+      if (!check_valid_addr(f, (char*)(args + 0x08)))
+        return;
+      syscall_readdir(f, args[1], (char*)args[2]);
+      break;
+    case SYS_ISDIR:
+      syscall_isdir(f, args[1]);
+      break;
+    case SYS_INUMBER:
+      syscall_inumber(f, args[1]);
+      break;
+    case SYS_FALLOCATE:
+      if (!check_valid_addr(f, (char*)(args + 0x10)))
+        return;
+      syscall_fallocate(f, args[1], args[2], args[3]);
+      break;
+    case SYS_GETDENTS:
+      if (!check_valid_addr(f, (char*)(args + 0x10)))
+        return;
+      syscall_getdents(f, args[1], (void*)args[2], args[3]);
+      break;
+    case SYS_COPY_FILE_RANGE:
+      if (!check_valid_addr(f, (char*)(args + 0x10)))
+        return;
+      syscall_copy_file_range(f, args[1], args[2], args[3]);
+      break;
+    case SYS_FSSTAT:
+      syscall_fsstat(f, (struct fsstat*)args[1]);
+      break;
+    case SYS_FRAGMENTS:
+      syscall_fragments(f, args[1]);
+      break;
+    case SYS_DEFRAG:
+      syscall_defrag(f, args[1]);
+      break;
     default:
       break;
   }
@@ -0,0 +1,167 @@
+#include "vm/compress.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/vaddr.h"
+
+/* A byte-oriented LZ77 compressor for single pages, in the style
+   of LZ4's block format.
+
+   The output is a series of sequences.  Each starts with a token
+   byte whose high nibble is a count of literal bytes and whose
+   low nibble is a match length minus MIN_MATCH.  A nibble of 15
+   means the count continues in following bytes, each added to
+   it, up to and including the first byte that is not 255.  The
+   literal bytes come next, then a 2-byte little-endian offset
+   back to the start of the match.  The final sequence has only
+   literals and ends the input.
+
+   Matches are found through a hash table of recent positions of
+   each 4-byte string, so compression takes a single pass and
+   decompression is a plain copy loop. */
+
+#define MIN_MATCH 4  /* Shortest match worth encoding. */
+#define HASH_BITS 10 /* log2 of hash table size. */
+
+/* Positions plus 1 of recent 4-byte strings, 0 if none.  Using
+   one static table keeps it off the 4 kB kernel stack, so
+   callers must not compress concurrently. */
+static uint16_t hash_table[1 << HASH_BITS];
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static unsigned hash32(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+/* Output cursor that refuses to run past the end. */
+struct output {
+  uint8_t* p;   /* Next byte to write. */
+  uint8_t* end; /* End of buffer. */
+};
+
+static bool put_byte(struct output* out, uint8_t b) {
+  if (out->p >= out->end)
+    return false;
+  *out->p++ = b;
+  return true;
+}
+
+/* Writes the continuation bytes for a nibble count of N. */
+static bool put_length(struct output* out, size_t n) {
+  for (; n >= 255; n -= 255)
+    if (!put_byte(out, 255))
+      return false;
+  return put_byte(out, n);
+}
+
+/* Emits one sequence of LIT_LEN literals from LIT followed, if
+   MATCH_LEN is nonzero, by a match of MATCH_LEN bytes at OFFSET
+   bytes back. */
+static bool put_sequence(struct output* out, const uint8_t* lit, size_t lit_len, size_t offset,
+                         size_t match_len) {
+  size_t m = match_len > 0 ? match_len - MIN_MATCH : 0;
+  uint8_t token = (lit_len < 15 ? lit_len : 15) << 4 | (m < 15 ? m : 15);
+
+  if (!put_byte(out, token) || (lit_len >= 15 && !put_length(out, lit_len - 15)))
+    return false;
+  if ((size_t)(out->end - out->p) < lit_len)
+    return false;
+  memcpy(out->p, lit, lit_len);
+  out->p += lit_len;
+
+  if (match_len == 0)
+    return true;
+  return put_byte(out, offset & 0xff) && put_byte(out, offset >> 8) &&
+         (m < 15 || put_length(out, m - 15));
+}
+
+/* Compresses the PGSIZE bytes at PAGE into DST, which is
+   DST_SIZE bytes long.  Returns the compressed size, or 0 if it
+   would not fit in DST_SIZE bytes.  Not reentrant. */
+size_t compress_page(const void* page, void* dst, size_t dst_size) {
+  const uint8_t* src = page;
+  struct output out = {dst, (uint8_t*)dst + dst_size};
+  size_t ip = 0, anchor = 0;
+
+  memset(hash_table, 0, sizeof hash_table);
+  while (ip + MIN_MATCH <= PGSIZE) {
+    unsigned h = hash32(read32(src + ip));
+    size_t cand = hash_table[h];
+    hash_table[h] = ip + 1;
+
+    if (cand-- > 0 && read32(src + cand) == read32(src + ip)) {
+      size_t len = MIN_MATCH;
+      while (ip + len < PGSIZE && src[cand + len] == src[ip + len])
+        len++;
+      if (!put_sequence(&out, src + anchor, ip - anchor, ip - cand, len))
+        return 0;
+      ip += len;
+      anchor = ip;
+    } else
+      ip++;
+  }
+  if (!put_sequence(&out, src + anchor, PGSIZE - anchor, 0, 0))
+    return 0;
+  return out.p - (uint8_t*)dst;
+}
+
+/* Reads a nibble count that started as N from *IP, advancing *IP
+   past any continuation bytes.  Returns false on truncated
+   input. */
+static bool get_length(const uint8_t** ip, const uint8_t* end, size_t* n) {
+  if (*n < 15)
+    return true;
+  for (;;) {
+    uint8_t b;
+    if (*ip >= end)
+      return false;
+    b = *(*ip)++;
+    *n += b;
+    if (b != 255)
+      return true;
+  }
+}
+
+/* Decompresses SRC_SIZE bytes at SRC, produced by
+   compress_page(), into the page at PAGE.  Returns true if
+   successful, false if SRC is malformed. */
+bool decompress_page(const void* src, size_t src_size, void* page) {
+  const uint8_t* ip = src;
+  const uint8_t* end = ip + src_size;
+  uint8_t* op = page;
+  uint8_t* op_end = op + PGSIZE;
+
+  while (ip < end) {
+    uint8_t token = *ip++;
+    size_t lit_len = token >> 4;
+    size_t match_len = token & 15;
+    size_t offset;
+
+    if (!get_length(&ip, end, &lit_len) || (size_t)(end - ip) < lit_len ||
+        (size_t)(op_end - op) < lit_len)
+      return false;
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return false;
+    offset = ip[0] | ip[1] << 8;
+    ip += 2;
+    if (!get_length(&ip, end, &match_len))
+      return false;
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - (uint8_t*)page) || (size_t)(op_end - op) < match_len)
+      return false;
+
+    /* Byte by byte, since the match may overlap its output. */
+    for (; match_len > 0; match_len--, op++)
+      *op = op[-offset];
+  }
+  return op == op_end;
+}
@@ -0,0 +1,10 @@
+#ifndef VM_COMPRESS_H
+#define VM_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+size_t compress_page(const void* page, void* dst, size_t dst_size);
+bool decompress_page(const void* src, size_t src_size, void* page);
+
+#endif /* vm/compress.h */
@@ -0,0 +1,96 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* Frame table: every frame of the user pool that holds an
+   evictable page, in clock order.  Shared text frames are not
+   listed, so they are never evicted.
+
+   The frame table has no lock of its own.  Its callers in
+   vm/page.c hold vm_lock, which also protects the pages the
+   frames point to. */
+static struct list frames;
+
+/* Clock hand: the next frame to consider for eviction, or the
+   list tail to start over from the front. */
+static struct list_elem* hand;
+
+/* Initializes the frame table. */
+void frame_init(void) {
+  list_init(&frames);
+  hand = list_end(&frames);
+}
+
+/* Advances the clock hand and returns the frame it passes. */
+static struct frame* clock_next(void) {
+  if (hand == list_end(&frames))
+    hand = list_begin(&frames);
+  struct frame* f = list_entry(hand, struct frame, elem);
+  hand = list_next(hand);
+  return f;
+}
+
+/* Chooses a frame by the clock algorithm, skipping pinned frames
+   and giving recently accessed ones a second chance, and writes
+   its page out to swap.  Returns the frame, still in the frame
+   table, or a null pointer if every frame is pinned or swap is
+   full. */
+struct frame* frame_evict(void) {
+  size_t tries;
+
+  /* Two sweeps clear every accessed bit, so a third finds a
+     victim if one is to be had. */
+  for (tries = 3 * list_size(&frames); tries > 0; tries--) {
+    struct frame* f = clock_next();
+    struct page* page = f->page;
+
+    if (f->pin_cnt > 0)
+      continue;
+    if (pagedir_is_accessed(page->pagedir, page->upage)) {
+      pagedir_set_accessed(page->pagedir, page->upage, false);
+      continue;
+    }
+    if (!page_evict(page))
+      return NULL;
+    f->page = NULL;
+    return f;
+  }
+  return NULL;
+}
+
+/* Obtains a frame for PAGE, evicting another page if the user
+   pool is exhausted, and returns it pinned.  Returns a null
+   pointer if no frame can be had. */
+struct frame* frame_alloc(struct page* page) {
+  void* kpage = palloc_get_page(PAL_USER);
+  struct frame* f;
+
+  if (kpage != NULL) {
+    f = malloc(sizeof *f);
+    if (f == NULL) {
+      palloc_free_page(kpage);
+      return NULL;
+    }
+    f->kpage = kpage;
+    list_push_back(&frames, &f->elem);
+  } else {
+    f = frame_evict();
+    if (f == NULL)
+      return NULL;
+  }
+  f->page = page;
+  f->pin_cnt = 1;
+  return f;
+}
+
+/* Removes F from the frame table and frees it. */
+void frame_free(struct frame* f) {
+  if (hand == &f->elem)
+    hand = list_next(hand);
+  list_remove(&f->elem);
+  palloc_free_page(f->kpage);
+  free(f);
+}
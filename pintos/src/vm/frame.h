@@ -0,0 +1,21 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+
+struct page;
+
+/* A frame of user memory holding a page that may be evicted. */
+struct frame {
+  struct list_elem elem; /* Element in frame table. */
+  void* kpage;           /* Kernel virtual address of frame. */
+  struct page* page;     /* Page held in the frame. */
+  int pin_cnt;           /* Nonzero to keep the frame resident. */
+};
+
+void frame_init(void);
+struct frame* frame_alloc(struct page*);
+void frame_free(struct frame*);
+struct frame* frame_evict(void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,589 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+
+/* Each process has a page table, a hash of struct page keyed by
+   user address, describing its private pages whether or not they
+   are resident.  A resident page is in a frame of the frame
+   table, from which it may be evicted to swap; a page fault
+   brings it back.
+
+   Executable segments are file maps: their pages are read from
+   the file on first access instead of at load time.  Read-only
+   pages of a file map are mapped from vm/share.c and have no
+   entry in the page table.
+
+   A page that has only ever been read and holds nothing but
+   zeros, such as untouched heap or BSS, is mapped read-only to
+   the single zero frame instead of a frame of its own.  Its
+   first write faults and copies it to a private frame.
+
+   vm_lock protects every page table, the frame table, and swap.
+   A process's heap_lock, which also serializes its page faults,
+   is acquired before it. */
+static struct lock vm_lock;
+
+/* A frame of zeros, mapped read-only wherever a page of zeros
+   has not been written yet. */
+static void* zero_kpage;
+
+/* A region of a process's address space backed by a file. */
+struct file_map {
+  struct list_elem elem; /* Element in process's file_maps. */
+  struct file* file;     /* Backing file. */
+  off_t ofs;             /* Offset in FILE of START. */
+  uint8_t* start;        /* First page of the region. */
+  uint8_t* end;          /* End of the region, page-aligned. */
+  size_t read_bytes;     /* Bytes read from FILE; the rest are zero. */
+  bool writable;         /* Private writable pages, or shared ones? */
+
+  /* Sequential access detection. */
+  uint8_t* next_fault; /* Page a sequential scan faults on next. */
+  size_t ra_pages;     /* Pages read ahead on the last fault. */
+};
+
+/* A fault on a file map also maps the pages around it, within an
+   aligned block of this many pages, that need no I/O. */
+#define FAULT_AROUND_PAGES 16
+
+/* Most pages read ahead on a sequential fault. */
+#define MAX_READ_AHEAD 32
+
+/* Initializes the page layer. */
+void page_init(void) {
+  lock_init(&vm_lock);
+  zero_kpage = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+  frame_init();
+}
+
+static unsigned page_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct page* p = hash_entry(e, struct page, elem);
+  return hash_bytes(&p->upage, sizeof p->upage);
+}
+
+static bool page_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct page* a = hash_entry(a_, struct page, elem);
+  const struct page* b = hash_entry(b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Initializes PCB's page table. */
+void page_table_init(struct process* pcb) {
+  hash_init(&pcb->pages, page_hash, page_less, NULL);
+  list_init(&pcb->file_maps);
+}
+
+/* Returns the current process's page at UPAGE, or a null
+   pointer if there is none.  vm_lock must be held. */
+static struct page* page_lookup(const void* upage) {
+  struct process* pcb = thread_current()->pcb;
+  struct page key;
+  struct hash_elem* e;
+
+  ASSERT(lock_held_by_current_thread(&vm_lock));
+  key.upage = (void*)upage;
+  e = hash_find(&pcb->pages, &key.elem);
+  return e != NULL ? hash_entry(e, struct page, elem) : NULL;
+}
+
+/* Unmaps PAGE and releases its frame or saved copy and PAGE
+   itself.  vm_lock must be held. */
+static void destroy_page(struct page* page) {
+  pagedir_clear_page(page->pagedir, page->upage);
+  if (page->frame != NULL)
+    frame_free(page->frame);
+  else
+    swap_discard(page);
+  free(page);
+}
+
+static void destroy_action(struct hash_elem* e, void* aux UNUSED) {
+  destroy_page(hash_entry(e, struct page, elem));
+}
+
+/* Frees every page in PCB's page table and its file maps.  This
+   must be done before its page directory is destroyed, which
+   would otherwise free frames still in the frame table. */
+void page_table_destroy(struct process* pcb) {
+  lock_acquire(&vm_lock);
+  hash_destroy(&pcb->pages, destroy_action);
+  while (!list_empty(&pcb->file_maps))
+    free(list_entry(list_pop_front(&pcb->file_maps), struct file_map, elem));
+  lock_release(&vm_lock);
+}
+
+/* Returns the current process's file map containing UPAGE, or a
+   null pointer if there is none. */
+static struct file_map* find_map(const void* upage) {
+  struct process* pcb = thread_current()->pcb;
+  struct list_elem* e;
+
+  for (e = list_begin(&pcb->file_maps); e != list_end(&pcb->file_maps); e = list_next(e)) {
+    struct file_map* map = list_entry(e, struct file_map, elem);
+    if ((const uint8_t*)upage >= map->start && (const uint8_t*)upage < map->end)
+      return map;
+  }
+  return NULL;
+}
+
+/* Returns the number of bytes of UPAGE, within MAP, that come
+   from MAP's file. */
+static size_t map_read_bytes(const struct file_map* map, const uint8_t* upage) {
+  size_t page_ofs = upage - map->start;
+  if (page_ofs >= map->read_bytes)
+    return 0;
+  return map->read_bytes - page_ofs < PGSIZE ? map->read_bytes - page_ofs : PGSIZE;
+}
+
+/* Returns true if UPAGE, within MAP, is mapped from vm/share.c
+   rather than through the page table. */
+static bool map_is_shared(const struct file_map* map, const uint8_t* upage) {
+  return !map->writable && map_read_bytes(map, upage) > 0;
+}
+
+/* Returns true if PAGE, which has no frame, holds only zeros. */
+static bool page_is_zero(const struct page* page) {
+  return page->clean && (page->map == NULL || map_read_bytes(page->map, page->upage) == 0);
+}
+
+/* Adds READ_BYTES + ZERO_BYTES bytes at UPAGE to the current
+   process, the first READ_BYTES of them read from FILE starting
+   at offset OFS and the rest zero, writable if WRITABLE is true.
+   Nothing is read until the pages are touched.  FILE must stay
+   open until the process exits.  Returns false if the region
+   overlaps an existing map or memory is short. */
+bool page_map_file(struct file* file, off_t ofs, void* upage, size_t read_bytes, size_t zero_bytes,
+                   bool writable) {
+  struct process* pcb = thread_current()->pcb;
+  struct file_map* map;
+  struct list_elem* e;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(ofs % PGSIZE == 0);
+  ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
+
+  map = malloc(sizeof *map);
+  if (map == NULL)
+    return false;
+  map->file = file;
+  map->ofs = ofs;
+  map->start = upage;
+  map->end = map->start + read_bytes + zero_bytes;
+  map->read_bytes = read_bytes;
+  map->writable = writable;
+  map->next_fault = NULL;
+  map->ra_pages = 0;
+
+  lock_acquire(&vm_lock);
+  for (e = list_begin(&pcb->file_maps); e != list_end(&pcb->file_maps); e = list_next(e)) {
+    struct file_map* m = list_entry(e, struct file_map, elem);
+    if (map->start < m->end && m->start < map->end) {
+      lock_release(&vm_lock);
+      free(map);
+      return false;
+    }
+  }
+  list_push_back(&pcb->file_maps, &map->elem);
+  lock_release(&vm_lock);
+  return true;
+}
+
+/* Adds a page at UPAGE, within MAP if it is nonnull, to the
+   current process's page table, without a frame.  vm_lock must
+   be held.  Returns the page, or a null pointer if UPAGE is
+   already in use or memory is short. */
+static struct page* add_page(void* upage, bool writable, struct file_map* map) {
+  struct process* pcb = thread_current()->pcb;
+  struct page* page;
+
+  ASSERT(pg_ofs(upage) == 0);
+  if (pagedir_get_page(pcb->pagedir, upage) != NULL)
+    return NULL;
+
+  page = malloc(sizeof *page);
+  if (page == NULL)
+    return NULL;
+  page->upage = upage;
+  page->pagedir = pcb->pagedir;
+  page->writable = writable;
+  page->frame = NULL;
+  page->map = map;
+  page->clean = true;
+  page->swap_slot = SWAP_NONE;
+  page->zdata = NULL;
+  page->zsize = 0;
+  if (hash_insert(&pcb->pages, &page->elem) != NULL) {
+    free(page);
+    return NULL;
+  }
+  return page;
+}
+
+/* Removes PAGE, which has no frame, from the current process's
+   page table and frees it.  vm_lock must be held. */
+static void remove_page(struct page* page) {
+  hash_delete(&thread_current()->pcb->pages, &page->elem);
+  destroy_page(page);
+}
+
+/* Fills KPAGE with PAGE's contents: from swap if it was saved
+   there, otherwise from its file map or zeros.  Returns false if
+   reading the file fails. */
+static bool fill_page(struct page* page, uint8_t* kpage) {
+  if (!page->clean)
+    swap_in(page, kpage);
+  else if (page->map != NULL) {
+    struct file_map* map = page->map;
+    size_t read_bytes = map_read_bytes(map, page->upage);
+    off_t ofs = map->ofs + ((uint8_t*)page->upage - map->start);
+
+    if (file_read_at(map->file, kpage, read_bytes, ofs) != (off_t)read_bytes)
+      return false;
+    memset(kpage + read_bytes, 0, PGSIZE - read_bytes);
+  } else
+    memset(kpage, 0, PGSIZE);
+  return true;
+}
+
+/* Brings PAGE into a frame and maps it.  The frame stays pinned
+   if PIN is true.  A page of zeros that is not about to be
+   written, as indicated by WRITE, is mapped to the zero frame
+   instead.  vm_lock must be held. */
+static bool load_page(struct page* page, bool pin, bool write) {
+  struct frame* f;
+
+  if (!pin && !write && page_is_zero(page))
+    return pagedir_set_page(page->pagedir, page->upage, zero_kpage, false);
+
+  /* Copy on write from the zero frame. */
+  pagedir_clear_page(page->pagedir, page->upage);
+  f = frame_alloc(page);
+  if (f == NULL)
+    return false;
+  if (!fill_page(page, f->kpage) ||
+      !pagedir_set_page(page->pagedir, page->upage, f->kpage, page->writable)) {
+    frame_free(f);
+    return false;
+  }
+  page->frame = f;
+  if (!pin)
+    f->pin_cnt--;
+  return true;
+}
+
+/* Adds a zeroed page at UPAGE to the current process, writable
+   if WRITABLE is true.  Returns its kernel address, pinned so
+   the caller can fill it in before calling page_unpin(), or a
+   null pointer if UPAGE is already in use or memory is short. */
+void* page_alloc(void* upage, bool writable) {
+  struct page* page;
+  void* kpage = NULL;
+
+  lock_acquire(&vm_lock);
+  page = add_page(upage, writable, NULL);
+  if (page != NULL) {
+    if (load_page(page, true, true))
+      kpage = page->frame->kpage;
+    else
+      remove_page(page);
+  }
+  lock_release(&vm_lock);
+  return kpage;
+}
+
+/* Undoes one pin of the current process's page at UPAGE. */
+void page_unpin(void* upage) {
+  struct page* page;
+
+  lock_acquire(&vm_lock);
+  page = page_lookup(upage);
+  if (page != NULL && page->frame != NULL && page->frame->pin_cnt > 0)
+    page->frame->pin_cnt--;
+  lock_release(&vm_lock);
+}
+
+/* Removes the current process's page at UPAGE, if any. */
+void page_free(void* upage) {
+  struct page* page;
+
+  lock_acquire(&vm_lock);
+  page = page_lookup(upage);
+  if (page != NULL)
+    remove_page(page);
+  lock_release(&vm_lock);
+}
+
+/* Returns true if the current process has a page at UPAGE,
+   resident or not. */
+bool page_exists(const void* upage) {
+  bool exists;
+
+  lock_acquire(&vm_lock);
+  exists = page_lookup(upage) != NULL;
+  lock_release(&vm_lock);
+  return exists;
+}
+
+/* Unmaps PAGE from its frame, which the caller then owns,
+   writing it out to swap unless it is clean.  vm_lock must be
+   held.  Returns false if swap is full, leaving PAGE mapped. */
+bool page_evict(struct page* page) {
+  bool dirty;
+
+  ASSERT(lock_held_by_current_thread(&vm_lock));
+
+  /* Unmap first, so that the owner faults, and waits for
+     vm_lock, instead of changing the page while it is saved. */
+  dirty = pagedir_is_dirty(page->pagedir, page->upage);
+  pagedir_clear_page(page->pagedir, page->upage);
+  if (!page->clean || dirty) {
+    if (!swap_out(page, page->frame->kpage)) {
+      pagedir_set_page(page->pagedir, page->upage, page->frame->kpage, page->writable);
+      if (dirty)
+        pagedir_set_dirty(page->pagedir, page->upage, true);
+      return false;
+    }
+    page->clean = false;
+  }
+  page->frame = NULL;
+  return true;
+}
+
+/* Updates MAP's sequential access state for a fault at UPAGE
+   and returns the number of pages after it to read ahead.  The
+   window doubles on each fault that continues a sequential scan
+   and collapses on any other.  vm_lock must be held. */
+static size_t read_ahead_window(struct file_map* map, uint8_t* upage) {
+  size_t pages;
+
+  if (upage == map->next_fault)
+    pages = map->ra_pages == 0 ? 2 : map->ra_pages * 2;
+  else
+    pages = 0;
+  if (pages > MAX_READ_AHEAD)
+    pages = MAX_READ_AHEAD;
+  if (pages > (size_t)(map->end - upage) / PGSIZE - 1)
+    pages = (map->end - upage) / PGSIZE - 1;
+  map->ra_pages = pages;
+  map->next_fault = upage + (pages + 1) * PGSIZE;
+  return pages;
+}
+
+/* Loads up to PAGES private pages of MAP after UPAGE that are
+   not resident, stopping at the first failure.  The read-ahead
+   pages are not marked accessed, so they are the first to be
+   evicted if they go unused.  vm_lock must be held. */
+static void read_ahead_private(struct file_map* map, uint8_t* upage, size_t pages) {
+  for (; pages > 0; pages--) {
+    struct page* page;
+
+    upage += PGSIZE;
+    page = page_lookup(upage);
+    if (page == NULL) {
+      page = add_page(upage, map->writable, map);
+      if (page == NULL)
+        return;
+      if (!load_page(page, false, false)) {
+        remove_page(page);
+        return;
+      }
+    } else if (page->frame == NULL && !page_is_zero(page) && !load_page(page, false, false))
+      return;
+  }
+}
+
+/* Maps the shared page at UPAGE within MAP, reading it in only
+   if CACHED_ONLY is false.  Returns true if UPAGE is now
+   mapped. */
+static bool map_shared(struct file_map* map, uint8_t* upage, bool cached_only) {
+  uint32_t* pd = thread_current()->pcb->pagedir;
+  size_t read_bytes = map_read_bytes(map, upage);
+  off_t ofs = map->ofs + (upage - map->start);
+
+  if (pagedir_get_page(pd, upage) != NULL)
+    return true;
+  if (cached_only)
+    return share_map_cached(map->file, ofs, read_bytes, upage);
+  return share_map_page(map->file, ofs, read_bytes, upage);
+}
+
+/* Maps the shared page of MAP at UPAGE, then reads ahead PAGES
+   pages after it and maps any already-loaded pages around it, so
+   that neither a sequential scan nor a second process running
+   the same executable faults on every page.  Must be called
+   without vm_lock, which vm/share.c may acquire to reclaim
+   memory.  Returns true if UPAGE is mapped. */
+static bool fault_shared(struct file_map* map, uint8_t* upage, size_t pages) {
+  uint8_t* block = map->start + ROUND_DOWN((size_t)(upage - map->start), FAULT_AROUND_PAGES * PGSIZE);
+  uint8_t* block_end = block + FAULT_AROUND_PAGES * PGSIZE;
+  uint8_t* p;
+
+  if (!map_shared(map, upage, false))
+    return false;
+  for (p = upage + PGSIZE; pages > 0 && map_is_shared(map, p); p += PGSIZE, pages--)
+    if (!map_shared(map, p, false))
+      break;
+  for (p = block; p < block_end && p < map->end; p += PGSIZE)
+    if (p != upage && map_is_shared(map, p))
+      map_shared(map, p, true);
+  return true;
+}
+
+/* Handles a fault on the page of the current process containing
+   FAULT_ADDR, caused by a write if WRITE is true.  Evicted pages
+   are read back from swap, and pages of file maps are read from
+   their files on first access, with read-ahead on sequential
+   faults.  Heap pages below the break are demand-zero.  A write
+   to a page mapped to the zero frame gets a private copy.
+   Returns true if the access can now proceed, false if
+   FAULT_ADDR is not part of any region the process owns or does
+   not allow the access. */
+bool page_fault_in(const void* fault_addr, bool write) {
+  struct process* pcb = thread_current()->pcb;
+  uint8_t* upage = pg_round_down(fault_addr);
+  struct file_map* map;
+  struct page* page;
+  void* kpage;
+  size_t ra_pages = 0;
+  bool shared = false;
+  bool success = false;
+
+  if (pcb == NULL || pcb->pagedir == NULL || !is_user_vaddr(fault_addr))
+    return false;
+
+  lock_acquire(&pcb->heap_lock);
+  lock_acquire(&vm_lock);
+  page = page_lookup(upage);
+  kpage = pagedir_get_page(pcb->pagedir, upage);
+  if (kpage != NULL) {
+    /* Present: a write to the zero frame, or a fault that
+       another thread already handled. */
+    if (page != NULL && page->writable && kpage == zero_kpage && write)
+      success = load_page(page, false, true);
+    else
+      success = page != NULL ? page->writable || !write : !write;
+    lock_release(&vm_lock);
+    lock_release(&pcb->heap_lock);
+    return success;
+  }
+
+  map = page != NULL ? page->map : find_map(upage);
+  if (map != NULL)
+    ra_pages = read_ahead_window(map, upage);
+
+  if (page != NULL)
+    success = load_page(page, false, write);
+  else if (map != NULL && map_is_shared(map, upage))
+    shared = true;
+  else if (map != NULL || (upage >= pcb->heap_start && (uint8_t*)fault_addr < pcb->heap_end)) {
+    page = add_page(upage, map != NULL ? map->writable : true, map);
+    if (page != NULL) {
+      success = load_page(page, false, write);
+      if (!success)
+        remove_page(page);
+    }
+  }
+  if (success && map != NULL)
+    read_ahead_private(map, upage, ra_pages);
+  lock_release(&vm_lock);
+
+  if (shared)
+    success = fault_shared(map, upage, ra_pages);
+  lock_release(&pcb->heap_lock);
+  return success;
+}
+
+/* Faults in the page of the current process at UPAGE and pins
+   it, so that the kernel can access it without faulting while
+   it holds locks the fault handler might need.  If WRITE is
+   true, the page must be writable.  Returns false if UPAGE is
+   not a valid page for the access. */
+static bool pin_page(const void* upage, bool write) {
+  uint32_t* pd = thread_current()->pcb->pagedir;
+
+  for (;;) {
+    struct page* page;
+    bool writable, ok = false;
+
+    lock_acquire(&vm_lock);
+    page = page_lookup(upage);
+    if (page != NULL && page->frame != NULL && (page->writable || !write)) {
+      page->frame->pin_cnt++;
+      ok = true;
+    }
+    writable = page != NULL && page->writable;
+    lock_release(&vm_lock);
+    if (ok)
+      return true;
+
+    /* Shared text and read-only zero pages are never evicted
+       and need no pin. */
+    if (!writable && pagedir_get_page(pd, upage) != NULL)
+      return !write;
+
+    /* A writable page on the zero frame gets a frame of its own
+       to pin, even for reading, since the zero frame would be
+       replaced under the reader by the first write. */
+    if (!page_fault_in(upage, write || writable))
+      return false;
+  }
+}
+
+/* Pins the pages of the current process spanning SIZE bytes at
+   UADDR, as pin_page() does for each.  Returns false, with none
+   pinned, if any of them is invalid. */
+bool page_pin_user(const void* uaddr, size_t size, bool write) {
+  const uint8_t* start = pg_round_down(uaddr);
+  const uint8_t* end = (const uint8_t*)uaddr + size;
+  const uint8_t* upage;
+
+  if (size == 0)
+    return true;
+  if (end < (const uint8_t*)uaddr || !is_user_vaddr(end - 1))
+    return false;
+  for (upage = start; upage < end; upage += PGSIZE)
+    if (!pin_page(upage, write)) {
+      if (upage > start)
+        page_unpin_user(start, upage - start);
+      return false;
+    }
+  return true;
+}
+
+/* Unpins the pages pinned by page_pin_user(UADDR, SIZE). */
+void page_unpin_user(const void* uaddr, size_t size) {
+  const uint8_t* end = (const uint8_t*)uaddr + size;
+  const uint8_t* upage;
+
+  if (size == 0)
+    return;
+  for (upage = pg_round_down(uaddr); upage < end; upage += PGSIZE)
+    page_unpin((void*)upage);
+}
+
+/* Evicts one page and returns its frame to the user pool, for
+   allocations made outside the frame table.  Returns false if
+   no page could be evicted. */
+bool page_reclaim(void) {
+  struct frame* f;
+
+  lock_acquire(&vm_lock);
+  f = frame_evict();
+  if (f != NULL)
+    frame_free(f);
+  lock_release(&vm_lock);
+  return f != NULL;
+}
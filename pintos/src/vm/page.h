@@ -0,0 +1,52 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct process;
+
+/* A private page of a process's virtual memory.  Shared text
+   pages are tracked by vm/share.c instead. */
+struct page {
+  struct hash_elem elem; /* Element in process's page table. */
+  void* upage;           /* User virtual address. */
+  uint32_t* pagedir;     /* Owning process's page directory. */
+  bool writable;         /* Mapped writable? */
+  struct frame* frame;   /* Frame holding the page, or NULL. */
+  struct file_map* map;  /* File region containing the page, or NULL. */
+  bool clean;            /* Contents are zeros or match MAP's file? */
+
+  /* Where a page that is not clean is kept while it has no
+     frame: compressed in ZDATA if that is nonnull, otherwise in
+     swap slot SWAP_SLOT. */
+  size_t swap_slot;            /* Swap slot, or SWAP_NONE. */
+  void* zdata;                 /* Compressed contents, or NULL. */
+  size_t zsize;                /* Bytes in ZDATA. */
+  struct list_elem zswap_elem; /* Element in vm/swap.c's pool, if ZDATA. */
+};
+
+void page_init(void);
+void page_table_init(struct process*);
+void page_table_destroy(struct process*);
+
+bool page_map_file(struct file*, off_t ofs, void* upage, size_t read_bytes, size_t zero_bytes,
+                   bool writable);
+void* page_alloc(void* upage, bool writable);
+void page_unpin(void* upage);
+void page_free(void* upage);
+bool page_exists(const void* upage);
+
+bool page_fault_in(const void* fault_addr, bool write);
+bool page_pin_user(const void* uaddr, size_t size, bool write);
+void page_unpin_user(const void* uaddr, size_t size);
+bool page_reclaim(void);
+
+bool page_evict(struct page*);
+
+#endif /* vm/page.h */
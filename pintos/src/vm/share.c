@@ -0,0 +1,226 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* A read-only page of an executable, shared by every process
+   that maps the same page of the same file. */
+struct share_page {
+  struct hash_elem elem; /* Element in share_pages. */
+  block_sector_t sector; /* Inode sector of the backing file. */
+  off_t ofs;             /* Page-aligned offset within the file. */
+  size_t read_bytes;     /* Bytes read from the file, rest is zero. */
+  void* kpage;           /* Frame holding the page, or NULL. */
+  int map_cnt;           /* Number of mappings of KPAGE. */
+  bool loaded;           /* False while the first mapper reads it. */
+};
+
+/* One process's mapping of a shared page. */
+struct share_mapping {
+  struct list_elem elem;   /* Element in process's shared_pages. */
+  void* upage;             /* User virtual address of mapping. */
+  struct share_page* page; /* Page mapped at UPAGE. */
+};
+
+/* Shared pages, keyed by (sector, ofs, read_bytes). */
+static struct hash share_pages;
+
+/* Protects share_pages and the reference counts in it. */
+static struct lock share_lock;
+
+/* Signaled when a page finishes loading. */
+static struct condition share_loaded;
+
+static unsigned share_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct share_page* p = hash_entry(e, struct share_page, elem);
+  return hash_int(p->sector) ^ hash_int(p->ofs) ^ hash_int(p->read_bytes);
+}
+
+static bool share_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct share_page* a = hash_entry(a_, struct share_page, elem);
+  const struct share_page* b = hash_entry(b_, struct share_page, elem);
+  if (a->sector != b->sector)
+    return a->sector < b->sector;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  return a->read_bytes < b->read_bytes;
+}
+
+/* Initializes the shared page table. */
+void share_init(void) {
+  hash_init(&share_pages, share_hash, share_less, NULL);
+  lock_init(&share_lock);
+  cond_init(&share_loaded);
+}
+
+/* Drops one mapping of PAGE, freeing its frame when it was the
+   last one.  share_lock must be held. */
+static void release_page(struct share_page* page) {
+  ASSERT(lock_held_by_current_thread(&share_lock));
+  ASSERT(page->map_cnt > 0);
+
+  if (--page->map_cnt == 0) {
+    if (page->kpage != NULL) {
+      hash_delete(&share_pages, &page->elem);
+      palloc_free_page(page->kpage);
+    }
+    free(page);
+  }
+}
+
+/* Returns the shared page holding READ_BYTES bytes of FILE at
+   offset OFS followed by zeros, reading it in if no process has
+   it mapped yet, unless CACHED_ONLY is true.  The page's map
+   count is incremented.  Returns a null pointer if memory
+   allocation or the read fails, or if CACHED_ONLY is true and
+   the page is not already loaded. */
+static struct share_page* get_page(struct file* file, off_t ofs, size_t read_bytes,
+                                   bool cached_only) {
+  struct share_page key;
+  struct share_page* page;
+  struct hash_elem* e;
+  bool ok;
+
+  key.sector = inode_get_inumber(file_get_inode(file));
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+
+  lock_acquire(&share_lock);
+  e = hash_find(&share_pages, &key.elem);
+  if (e != NULL && cached_only && !hash_entry(e, struct share_page, elem)->loaded) {
+    lock_release(&share_lock);
+    return NULL;
+  } else if (e != NULL) {
+    /* Someone else has it mapped, or is reading it in. */
+    page = hash_entry(e, struct share_page, elem);
+    page->map_cnt++;
+    while (!page->loaded)
+      cond_wait(&share_loaded, &share_lock);
+  } else if (cached_only) {
+    lock_release(&share_lock);
+    return NULL;
+  } else {
+    page = malloc(sizeof *page);
+    if (page == NULL) {
+      lock_release(&share_lock);
+      return NULL;
+    }
+    /* Shared frames stay out of the frame table, so make room in
+       the user pool by evicting a private page if need be. */
+    while ((page->kpage = palloc_get_page(PAL_USER)) == NULL)
+      if (!page_reclaim())
+        break;
+    if (page->kpage == NULL) {
+      free(page);
+      lock_release(&share_lock);
+      return NULL;
+    }
+    page->sector = key.sector;
+    page->ofs = ofs;
+    page->read_bytes = read_bytes;
+    page->map_cnt = 1;
+    page->loaded = false;
+    hash_insert(&share_pages, &page->elem);
+
+    /* Read the page without holding the lock, so that loads of
+       other pages are not serialized behind this one. */
+    lock_release(&share_lock);
+    ok = file_read_at(file, page->kpage, read_bytes, ofs) == (off_t)read_bytes;
+    memset((uint8_t*)page->kpage + read_bytes, 0, PGSIZE - read_bytes);
+    lock_acquire(&share_lock);
+
+    if (!ok) {
+      hash_delete(&share_pages, &page->elem);
+      palloc_free_page(page->kpage);
+      page->kpage = NULL;
+    }
+    page->loaded = true;
+    cond_broadcast(&share_loaded, &share_lock);
+  }
+
+  if (page->kpage == NULL) {
+    release_page(page);
+    page = NULL;
+  }
+  lock_release(&share_lock);
+  return page;
+}
+
+/* Maps UPAGE as share_map_page() and share_map_cached() do. */
+static bool map_page(struct file* file, off_t ofs, size_t read_bytes, void* upage,
+                     bool cached_only) {
+  struct process* pcb = thread_current()->pcb;
+  struct share_mapping* mapping;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(ofs % PGSIZE == 0);
+  ASSERT(read_bytes <= PGSIZE);
+
+  mapping = malloc(sizeof *mapping);
+  if (mapping == NULL)
+    return false;
+  mapping->upage = upage;
+  mapping->page = get_page(file, ofs, read_bytes, cached_only);
+  if (mapping->page == NULL) {
+    free(mapping);
+    return false;
+  }
+
+  if (pagedir_get_page(pcb->pagedir, upage) != NULL ||
+      !pagedir_set_page(pcb->pagedir, upage, mapping->page->kpage, false)) {
+    lock_acquire(&share_lock);
+    release_page(mapping->page);
+    lock_release(&share_lock);
+    free(mapping);
+    return false;
+  }
+  list_push_back(&pcb->shared_pages, &mapping->elem);
+  return true;
+}
+
+/* Maps UPAGE in the current process, read-only, to the shared
+   copy of the page of FILE at offset OFS, whose first READ_BYTES
+   bytes come from FILE and whose remainder is zero.  Processes
+   running the same executable map the same frame, which is freed
+   once the last of them unmaps it.  Returns true if successful,
+   false if UPAGE is already mapped or an allocation or read
+   fails. */
+bool share_map_page(struct file* file, off_t ofs, size_t read_bytes, void* upage) {
+  return map_page(file, ofs, read_bytes, upage, false);
+}
+
+/* Maps UPAGE like share_map_page(), but only if another process
+   already has the page loaded, so that no I/O is needed.
+   Returns true if successful. */
+bool share_map_cached(struct file* file, off_t ofs, size_t read_bytes, void* upage) {
+  return map_page(file, ofs, read_bytes, upage, true);
+}
+
+/* Unmaps every shared page from the current process.  This must
+   be done before its page directory is destroyed, which would
+   otherwise free frames still mapped by other processes. */
+void share_unmap_all(void) {
+  struct process* pcb = thread_current()->pcb;
+
+  lock_acquire(&share_lock);
+  while (!list_empty(&pcb->shared_pages)) {
+    struct list_elem* e = list_pop_front(&pcb->shared_pages);
+    struct share_mapping* mapping = list_entry(e, struct share_mapping, elem);
+    if (pcb->pagedir != NULL)
+      pagedir_clear_page(pcb->pagedir, mapping->upage);
+    release_page(mapping->page);
+    free(mapping);
+  }
+  lock_release(&share_lock);
+}
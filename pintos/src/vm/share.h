@@ -0,0 +1,15 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+
+void share_init(void);
+bool share_map_page(struct file*, off_t ofs, size_t read_bytes, void* upage);
+bool share_map_cached(struct file*, off_t ofs, size_t read_bytes, void* upage);
+void share_unmap_all(void);
+
+#endif /* vm/share.h */
@@ -0,0 +1,168 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/compress.h"
+#include "vm/page.h"
+
+/* Evicted pages go first to a pool of compressed pages kept in
+   kernel memory, and only to the swap device when they do not
+   compress well.  Bringing a page back from the pool costs a
+   decompression instead of a disk read, which is much cheaper
+   for the zero-heavy pages that dominate most processes.  When
+   the pool is full, its oldest pages are written back to the
+   swap device to make room, so that the pool keeps the pages
+   evicted most recently, which are the likeliest to be wanted
+   again soon.
+
+   Callers hold vm_lock, which serializes all of the state here,
+   including the compressor's scratch space. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A page is kept compressed only if it shrinks to this size. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+static struct block* swap_device; /* Swap device, or NULL. */
+static struct bitmap* swap_slots; /* Used slots on swap_device. */
+
+static size_t zswap_limit; /* Bytes the pool may hold. */
+static size_t zswap_used;  /* Bytes the pool holds. */
+static struct list zswap_lru;  /* Pages in the pool, oldest first. */
+
+/* Scratch space for compressing one page, and for decompressing
+   one to write it back. */
+static uint8_t zswap_buf[ZSWAP_MAX_SIZE];
+static uint8_t zswap_page[PGSIZE];
+
+/* Statistics. */
+static long long zswap_stores, zswap_loads; /* Pages into and out of pool. */
+static long long swap_writes, swap_reads;   /* Pages to and from device. */
+
+/* Initializes swap, with a compressed pool of up to ZSWAP_PAGES
+   pages' worth of compressed data.  Zero disables the pool. */
+void swap_init(size_t zswap_pages) {
+  swap_device = block_get_role(BLOCK_SWAP);
+  if (swap_device != NULL) {
+    swap_slots = bitmap_create(block_size(swap_device) / SECTORS_PER_PAGE);
+    if (swap_slots == NULL)
+      PANIC("bitmap creation failed--swap device is too large");
+  }
+  zswap_limit = zswap_pages * PGSIZE;
+  list_init(&zswap_lru);
+}
+
+/* Writes KPAGE, the contents of PAGE, to a free slot on the swap
+   device.  Returns false if there is none. */
+static bool write_slot(struct page* page, const void* kpage) {
+  size_t slot, i;
+
+  if (swap_device == NULL)
+    return false;
+  slot = bitmap_scan_and_flip(swap_slots, 0, 1, false);
+  if (slot == BITMAP_ERROR)
+    return false;
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    block_write(swap_device, slot * SECTORS_PER_PAGE + i,
+                (const uint8_t*)kpage + i * BLOCK_SECTOR_SIZE);
+  page->swap_slot = slot;
+  swap_writes++;
+  return true;
+}
+
+/* Removes PAGE's compressed copy from the pool. */
+static void zswap_remove(struct page* page) {
+  list_remove(&page->zswap_elem);
+  free(page->zdata);
+  zswap_used -= page->zsize;
+  page->zdata = NULL;
+}
+
+/* Moves the oldest page in the pool to the swap device.  Returns
+   false if the pool is empty or the device is full. */
+static bool zswap_write_back(void) {
+  struct page* page;
+
+  if (list_empty(&zswap_lru))
+    return false;
+  page = list_entry(list_front(&zswap_lru), struct page, zswap_elem);
+  if (!decompress_page(page->zdata, page->zsize, zswap_page))
+    PANIC("corrupt compressed swap page");
+  if (!write_slot(page, zswap_page))
+    return false;
+  zswap_remove(page);
+  return true;
+}
+
+/* Tries to keep a compressed copy of KPAGE for PAGE in the
+   pool, writing older pages back to make room. */
+static bool zswap_store(struct page* page, const void* kpage) {
+  size_t size;
+
+  if (zswap_limit == 0)
+    return false;
+  size = compress_page(kpage, zswap_buf, sizeof zswap_buf);
+  if (size == 0 || size > zswap_limit)
+    return false;
+  while (zswap_used + size > zswap_limit)
+    if (!zswap_write_back())
+      return false;
+  page->zdata = malloc(size);
+  if (page->zdata == NULL)
+    return false;
+  memcpy(page->zdata, zswap_buf, size);
+  page->zsize = size;
+  list_push_back(&zswap_lru, &page->zswap_elem);
+  zswap_used += size;
+  zswap_stores++;
+  return true;
+}
+
+/* Saves the contents of KPAGE, which holds PAGE, so that
+   swap_in() can restore them.  Returns true if successful,
+   false if both the pool and the swap device are full. */
+bool swap_out(struct page* page, const void* kpage) {
+  ASSERT(page->zdata == NULL && page->swap_slot == SWAP_NONE);
+
+  return zswap_store(page, kpage) || write_slot(page, kpage);
+}
+
+/* Restores PAGE's contents, saved by swap_out(), into KPAGE and
+   releases the saved copy. */
+void swap_in(struct page* page, void* kpage) {
+  size_t i;
+
+  if (page->zdata != NULL) {
+    if (!decompress_page(page->zdata, page->zsize, kpage))
+      PANIC("corrupt compressed swap page");
+    zswap_loads++;
+  } else {
+    ASSERT(page->swap_slot != SWAP_NONE);
+    for (i = 0; i < SECTORS_PER_PAGE; i++)
+      block_read(swap_device, page->swap_slot * SECTORS_PER_PAGE + i,
+                 (uint8_t*)kpage + i * BLOCK_SECTOR_SIZE);
+    swap_reads++;
+  }
+  swap_discard(page);
+}
+
+/* Releases PAGE's saved copy, if any. */
+void swap_discard(struct page* page) {
+  if (page->zdata != NULL)
+    zswap_remove(page);
+  if (page->swap_slot != SWAP_NONE) {
+    bitmap_reset(swap_slots, page->swap_slot);
+    page->swap_slot = SWAP_NONE;
+  }
+}
+
+/* Prints swap statistics. */
+void swap_print_stats(void) {
+  printf("Swap: %lld pages compressed, %lld decompressed, "
+         "%lld written, %lld read\n",
+         zswap_stores, zswap_loads, swap_writes, swap_reads);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+
+/* Swap slot of a page that has none. */
+#define SWAP_NONE ((size_t)-1)
+
+void swap_init(size_t zswap_pages);
+bool swap_out(struct page*, const void* kpage);
+void swap_in(struct page*, void* kpage);
+void swap_discard(struct page*);
+void swap_print_stats(void);
+
+#endif /* vm/swap.h */